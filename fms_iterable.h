@@ -1,14 +1,47 @@
 // fms_iterable.h - iterators with operator bool() sentinel
 #pragma once
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cmath>
 #include <compare>
 #include <concepts>
+#include <condition_variable>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
 #include <functional>
 #include <iterator>
 #include <limits>
+#include <memory>
+#include <mutex>
 #include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
 #include <tuple>
 #include <utility>
+#include <vector>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FMS_ITERABLE_SSE2
+#include <emmintrin.h>
+#endif
+#ifdef __AVX2__
+#define FMS_ITERABLE_AVX2
+#include <immintrin.h>
+#endif
+#if defined(FMS_ITERABLE_LIBSTDCXX_DEQUE) && defined(__GLIBCXX__)
+#include <deque>
+#endif
+#ifdef FMS_ITERABLE_TRACE
+#include "fms_iterable_trace.h"
+#define FMS_ITERABLE_SPAN(name, cat) fms::iterable::trace_span fms_iterable_span_(name, cat)
+#else
+#define FMS_ITERABLE_SPAN(name, cat)
+#endif
 
 namespace fms::iterable {
 
@@ -80,20 +113,172 @@ namespace fms::iterable {
 	concept has_size = requires(I i) {
 		{ i.size() } -> std::same_as<std::size_t>;
 	};
+	template <class I>
+	concept has_drop = requires(I i, std::iter_difference_t<I> n) {
+		{ i.drop(n) } -> std::same_as<I>;
+	};
+
+	// operator bool() is always true.
+	template<class I>
+	struct is_infinite : std::false_type {};
+	template<class I>
+	inline constexpr bool is_infinite_v = is_infinite<I>::value;
+
+	// i.operator bool() without the call when I is known to be infinite.
+	template<class I>
+	constexpr bool valid(const I& i)
+	{
+		if constexpr (is_infinite_v<I>) {
+			return true;
+		}
+		else {
+			return i.operator bool();
+		}
+	}
+
+	// Internal iteration: push elements to s until s returns false.
+	template <class I, class S>
+	concept has_for_each_until = requires(I i, S s) {
+		{ i.for_each_until(s) } -> std::same_as<bool>;
+	};
+	// Call s(*i) for each element of i until s returns false.
+	// Returns false if s stopped iteration. Leaves i valid but unspecified.
+	// Adaptors provide a member for_each_until running their own tight loop.
+	template<class I, class S>
+	constexpr bool for_each_until(I& i, S&& s)
+	{
+		if constexpr (has_for_each_until<I, S>) {
+			return i.for_each_until(s);
+		}
+		else {
+			while (valid(i)) {
+				if (!s(*i)) {
+					return false;
+				}
+				++i;
+			}
+
+			return true;
+		}
+	}
+
+	// Bytes holding the state of an iterable. To resume, construct the same
+	// pipeline and load its state. Functions and predicates are not saved.
+	class archive {
+		std::vector<std::byte> b;
+		std::size_t off; // read position
+		bool ok; // no read past end
+	public:
+		archive()
+			: off(0), ok(true)
+		{ }
+		explicit archive(std::vector<std::byte> b)
+			: b(std::move(b)), off(0), ok(true)
+		{ }
+
+		const std::vector<std::byte>& bytes() const noexcept
+		{
+			return b;
+		}
+		explicit operator bool() const noexcept
+		{
+			return ok;
+		}
+
+		template<class T>
+			requires std::is_trivially_copyable_v<T>
+		archive& write(const T& t)
+		{
+			const auto n = b.size();
+			b.resize(n + sizeof(T));
+			std::memcpy(b.data() + n, &t, sizeof(T));
+
+			return *this;
+		}
+		template<class T>
+			requires std::is_trivially_copyable_v<T>
+		archive& read(T& t)
+		{
+			if (!ok || off + sizeof(T) > b.size()) {
+				ok = false;
+			}
+			else {
+				std::memcpy(&t, b.data() + off, sizeof(T));
+				off += sizeof(T);
+			}
+
+			return *this;
+		}
+	};
+
+	template<class I>
+	concept has_save = requires(const I& i, archive& a) {
+		i.save(a);
+	};
+	template<class I>
+	concept has_load = requires(I& i, archive& a) {
+		i.load(a);
+	};
+	// Values written as bytes. Specialize for trivially copyable types that
+	// hold no addresses. Pointers and iterators into memory are not savable.
+	template<class T>
+	struct savable_trait : std::bool_constant<std::is_arithmetic_v<T> || std::is_enum_v<T>> {};
+	template<class I>
+	concept savable = has_save<I> || (savable_trait<I>::value && std::is_trivially_copyable_v<I>);
+
+	// Append the state of i to a.
+	template<class I>
+		requires savable<I>
+	inline void save(const I& i, archive& a)
+	{
+		if constexpr (has_save<I>) {
+			i.save(a);
+		}
+		else {
+			a.write(i);
+		}
+	}
+	// Restore the state of i from a.
+	template<class I>
+		requires has_load<I> || (savable_trait<I>::value && std::is_trivially_copyable_v<I>)
+	inline void load(I& i, archive& a)
+	{
+		if constexpr (has_load<I>) {
+			i.load(a);
+		}
+		else {
+			a.read(i);
+		}
+	}
 
 	// Lexicographically compare at most n elements of two iterables
 	template<class I, class J>
 	constexpr auto compare(I i, J j)
 		requires has_end<I> && has_end<J>
 	{
-		while (i && j) {
-			const auto cmp = *i++ <=> *j++;
+		using R = decltype(*i <=> *j); // partial_ordering for floating point
+
+		R r = R::equivalent;
+		if (for_each_until(i, [&r, &j](const auto& t) {
+			if (!j) {
+				r = R::greater;
+
+				return false;
+			}
+			const auto cmp = t <=> *j;
+			++j;
 			if (cmp != 0) {
-				return cmp;
+				r = R(cmp);
+
+				return false;
 			}
+
+			return true;
+		}) && j) {
+			r = R::less;
 		}
 
-		return !!i <=> !!j;
+		return r;
 	}
 	// All elements are equal.
 	template<class I, class J>
@@ -131,8 +316,12 @@ namespace fms::iterable {
 	template<class I, class J>
 	constexpr auto copy(I i, J j)
 	{
-		while (i && j) {
-			*j++ = *i++;
+		if (j) {
+			for_each_until(i, [&j](const auto& t) {
+				*j++ = t;
+
+				return !!j;
+			});
 		}
 
 		return j;
@@ -207,9 +396,13 @@ namespace fms::iterable {
 
 	// Drop at most n from the beginning.
 	template <class I>
-	constexpr I drop(I i, std::iter_difference_t<I> n) noexcept
+	constexpr I drop(I i, std::iter_difference_t<I> n)
+		noexcept(!has_drop<I> || requires(I j, std::iter_difference_t<I> m) { { j.drop(m) } noexcept; })
 	{
-		if constexpr (has_end<I>) {
+		if constexpr (has_drop<I>) {
+			return i.drop(n);
+		}
+		else if constexpr (has_end<I>) {
 			return std::next(i, std::min(n, size(i)));
 		}
 		else {
@@ -223,13 +416,44 @@ namespace fms::iterable {
 		}
 	}
 
+	// Contiguous elements from iterator i to the end of its block.
+	// Iterators can provide a member segment() or specialize length.
+	template<class I>
+	struct segment_traits {};
+	template<class I>
+		requires requires(const I& i) { { i.segment() } -> std::same_as<std::size_t>; }
+	struct segment_traits<I> {
+		static std::size_t length(const I& i) noexcept
+		{
+			return i.segment();
+		}
+	};
+	// Define FMS_ITERABLE_LIBSTDCXX_DEQUE to traverse std::deque by block
+	// using libstdc++ internals.
+#if defined(FMS_ITERABLE_LIBSTDCXX_DEQUE) && defined(__GLIBCXX__)
+	template<class T, class R, class P>
+	struct segment_traits<std::_Deque_iterator<T, R, P>> {
+		static std::size_t length(const std::_Deque_iterator<T, R, P>& i) noexcept
+		{
+			return static_cast<std::size_t>(i._M_last - i._M_cur);
+		}
+	};
+#endif
+	template<class I>
+	concept segmented = std::random_access_iterator<I> && requires(const I& i) {
+		{ segment_traits<I>::length(i) } -> std::same_as<std::size_t>;
+	};
+
 	// Iterable over [b, e)
 	template<class I>
 	class interval : public I {
 		I e;
 	public:
+		using difference_type = std::iter_difference_t<I>;
+
+		constexpr interval() = default;
 		constexpr interval(I i, I e)
-			: I(i), e(e)
+			: I(std::move(i)), e(std::move(e))
 		{ }
 		constexpr interval(const interval& i) = default;
 		constexpr interval& operator=(const interval& i) = default;
@@ -237,7 +461,7 @@ namespace fms::iterable {
 		constexpr interval& operator=(interval&&) = default;
 		constexpr ~interval() = default;
 
-		constexpr auto operator<=>(const interval& i) const = default;
+		/*constexpr*/ auto operator<=>(const interval& i) const = default;
 
 		constexpr interval begin() const
 		{
@@ -252,6 +476,99 @@ namespace fms::iterable {
 		{
 			return *this != e;
 		}
+		// weakly incrementable
+		constexpr interval& operator++()
+		{
+			I::operator++();
+
+			return *this;
+		}
+		constexpr interval operator++(int)
+		{
+			auto tmp{ *this };
+
+			operator++();
+
+			return tmp;
+		}
+		// bidirectional
+		constexpr interval& operator--()
+			requires std::bidirectional_iterator<I>
+		{
+			I::operator--();
+
+			return *this;
+		}
+		constexpr interval operator--(int)
+			requires std::bidirectional_iterator<I>
+		{
+			auto tmp{ *this };
+
+			operator--();
+
+			return tmp;
+		}
+		// random access
+		constexpr interval& operator+=(difference_type d)
+			requires std::random_access_iterator<I>
+		{
+			static_cast<I&>(*this) += d;
+
+			return *this;
+		}
+		constexpr interval& operator-=(difference_type d)
+			requires std::random_access_iterator<I>
+		{
+			static_cast<I&>(*this) -= d;
+
+			return *this;
+		}
+		constexpr interval operator+(difference_type d) const
+			requires std::random_access_iterator<I>
+		{
+			return interval(static_cast<const I&>(*this) + d, e);
+		}
+		constexpr friend interval operator+(difference_type d, interval i)
+			requires std::random_access_iterator<I>
+		{
+			return i += d;
+		}
+		constexpr interval operator-(difference_type d) const
+			requires std::random_access_iterator<I>
+		{
+			return interval(static_cast<const I&>(*this) - d, e);
+		}
+		constexpr difference_type operator-(const interval& i) const
+			requires std::random_access_iterator<I>
+		{
+			return static_cast<const I&>(*this) - static_cast<const I&>(i);
+		}
+		constexpr decltype(auto) operator[](difference_type d) const
+			requires std::random_access_iterator<I>
+		{
+			return static_cast<const I&>(*this)[d];
+		}
+		// Tight pointer loop over each block of a segmented container.
+		template<class S>
+		bool for_each_until(S&& s)
+			requires segmented<I>
+		{
+			I& i = *this;
+			while (i != e) {
+				const auto n = std::min(segment_traits<I>::length(i), static_cast<std::size_t>(e - i));
+				const auto* p = std::addressof(*i);
+				for (std::size_t k = 0; k < n; ++k) {
+					if (!s(p[k])) {
+						i += static_cast<std::iter_difference_t<I>>(k);
+
+						return false;
+					}
+				}
+				i += static_cast<std::iter_difference_t<I>>(n);
+			}
+
+			return true;
+		}
 	};
 
 	// Assumes lifetime of container.
@@ -279,6 +596,17 @@ namespace fms::iterable {
 
 		constexpr auto operator<=>(const iota&) const = default;
 
+		void save(archive& a) const
+			requires savable<T>
+		{
+			fms::iterable::save(t, a);
+		}
+		void load(archive& a)
+			requires savable<T>
+		{
+			fms::iterable::load(t, a);
+		}
+
 		constexpr auto begin() const
 		{
 			return *this;
@@ -343,6 +671,19 @@ namespace fms::iterable {
 
 		constexpr bool operator==(const power& p) const = default;
 
+		void save(archive& a) const
+			requires savable<T>
+		{
+			fms::iterable::save(t, a);
+			fms::iterable::save(tn, a);
+		}
+		void load(archive& a)
+			requires savable<T>
+		{
+			fms::iterable::load(t, a);
+			fms::iterable::load(tn, a);
+		}
+
 		constexpr auto begin() const
 		{ 
 			return *this; 
@@ -407,6 +748,19 @@ namespace fms::iterable {
 
 		constexpr bool operator==(const factorial& f) const = default;
 
+		void save(archive& a) const
+			requires savable<T>
+		{
+			fms::iterable::save(t, a);
+			fms::iterable::save(n, a);
+		}
+		void load(archive& a)
+			requires savable<T>
+		{
+			fms::iterable::load(t, a);
+			fms::iterable::load(n, a);
+		}
+
 		constexpr auto begin() const
 		{
 			return *this;
@@ -455,6 +809,21 @@ namespace fms::iterable {
 
 		constexpr bool operator==(const choose& c) const = default;
 
+		void save(archive& a) const
+			requires savable<T>
+		{
+			fms::iterable::save(n, a);
+			fms::iterable::save(k, a);
+			fms::iterable::save(nk, a);
+		}
+		void load(archive& a)
+			requires savable<T>
+		{
+			fms::iterable::load(n, a);
+			fms::iterable::load(k, a);
+			fms::iterable::load(nk, a);
+		}
+
 		constexpr choose begin() const
 		{
 			return choose(n);
@@ -499,7 +868,7 @@ namespace fms::iterable {
 		T* p;
 	public:
 		using iterator_category = std::random_access_iterator_tag;
-		using value_type = T;
+		using value_type = std::remove_cv_t<T>;
 		using reference = T&;
 		using pointer = T*;
 		using difference_type = std::ptrdiff_t;
@@ -606,10 +975,15 @@ namespace fms::iterable {
 		}
 	};
 
-	// Iterable over [i, i + n).
-	template<class I>
+	// Iterable over [i, i + N) with N known at compile time.
+	// Internal iteration from the beginning is fully unrolled.
+	template<class I, std::size_t N = std::dynamic_extent>
 	class counted : public I {
-		std::size_t n;
+		std::size_t k; // position
+
+		constexpr counted(I i, std::size_t k)
+			: I(std::move(i)), k(k)
+		{ }
 	public:
 		using iterator_category = typename I::iterator_category;
 		using value_type = typename I::value_type;
@@ -617,9 +991,11 @@ namespace fms::iterable {
 		using pointer = typename I::pointer;
 		using difference_type = typename I::difference_type;
 
+		static constexpr std::size_t extent = N;
+
 		constexpr counted() = default;
-		constexpr counted(I i, std::size_t n)
-			: I(i), n(n)
+		constexpr explicit counted(I i)
+			: I(std::move(i)), k(0)
 		{ }
 		constexpr counted(const counted&) = default;
 		constexpr counted& operator=(const counted&) = default;
@@ -627,38 +1003,48 @@ namespace fms::iterable {
 		constexpr counted& operator=(counted&&) = default;
 		constexpr ~counted() = default;
 
-		/*constexpr*/ auto operator<=>(const counted& i) const = default;
+		constexpr auto operator<=>(const counted& i) const = default;
+
+		void save(archive& a) const
+			requires savable<I>
+		{
+			fms::iterable::save(static_cast<const I&>(*this), a);
+			fms::iterable::save(k, a);
+		}
+		void load(archive& a)
+			requires savable<I>
+		{
+			fms::iterable::load(static_cast<I&>(*this), a);
+			fms::iterable::load(k, a);
+		}
 
 		constexpr counted begin() const
 		{
-			return counted(I::begin(), n);
+			return *this;
 		}
 		constexpr counted end() const
 		{
-			return counted(drop(I::begin(), n), 0);
+			return counted(drop(I::begin(), N - k), N);
 		}
 
 		constexpr explicit operator bool() const noexcept
 		{
-			return n != 0;
+			return k != N;
 		}
-		// indirectly readable
-		constexpr value_type operator*() const noexcept
+		constexpr decltype(auto) operator*() const noexcept
 		{
 			return I::operator*();
 		}
-		// indirectly writable
 		constexpr reference operator*() noexcept
 			requires std::indirectly_writable<I, value_type>
 		{
 			return I::operator*();
 		}
-		// weakly incrementable
 		constexpr counted& operator++() noexcept
 		{
-			if (operator bool()) {
+			if (k != N) {
 				I::operator++();
-				--n;
+				++k;
 			}
 
 			return *this;
@@ -671,12 +1057,31 @@ namespace fms::iterable {
 
 			return tmp;
 		}
+		template<class S>
+		constexpr bool for_each_until(S&& s)
+		{
+			if (k == 0) {
+				k = N;
+
+				return [&]<std::size_t... J>(std::index_sequence<J...>) {
+					return ((s(I::operator*()) && (J + 1 == N || (I::operator++(), true))) && ...);
+				}(std::make_index_sequence<N>{});
+			}
+			for (; k != N; ++k) {
+				if (!s(I::operator*())) {
+					return false;
+				}
+				I::operator++();
+			}
+
+			return true;
+		}
 		// bidirectional
 		constexpr counted& operator--() noexcept
 			requires std::bidirectional_iterator<I>
 		{
 			I::operator--();
-			++n;
+			--k;
 
 			return *this;
 		}
@@ -694,25 +1099,25 @@ namespace fms::iterable {
 			requires std::random_access_iterator<I>
 		{
 			I::operator+=(d);
-			n -= d;
+			k += d;
 
 			return *this;
 		}
 		constexpr counted operator+(difference_type d) const noexcept
 			requires std::random_access_iterator<I>
 		{
-			return counted(I::operator+(d), n - d);
+			return counted(I::operator+(d), k + d);
 		}
-		constexpr friend counted<I> operator+(std::ptrdiff_t d, counted<I> c) noexcept
+		constexpr friend counted operator+(difference_type d, const counted& i) noexcept
 			requires std::random_access_iterator<I>
 		{
-			return c += d;
+			return i + d;
 		}
 		constexpr counted& operator-=(difference_type d) noexcept
 			requires std::random_access_iterator<I>
 		{
 			I::operator-=(d);
-			n += d;
+			k -= d;
 
 			return *this;
 		}
@@ -724,96 +1129,2006 @@ namespace fms::iterable {
 		constexpr counted operator-(difference_type d) const noexcept
 			requires std::random_access_iterator<I>
 		{
-			return counted(I::operator-(d), n + d);
+			return counted(I::operator-(d), k - d);
 		}
 		constexpr reference operator[](difference_type d) const noexcept
 			requires std::random_access_iterator<I>
 		{
 			return I::operator[](d);
 		}
-		constexpr reference operator[](difference_type d) noexcept
-			requires std::random_access_iterator<I>
-		{
-			return I::operator[](d);
-		}
 	};
 
-	// Assumes lifetime of a.
-	template<class T, std::size_t N>
-	constexpr auto array(T(&a)[N]) noexcept
-	{
-		return counted(ptr(a), N);
-	}
-
-	// Take at most n elements from i.
-	template<class I>
-	constexpr auto take(I i, std::iter_difference_t<I> n)
-	{
-		if constexpr (has_end<I>) {
-			n = std::min(n, size(i));
-		}
-
-		return counted(i, n);
-	}
-	// Iterable with no elements.
-	template<class T>
-	constexpr auto empty()
-	{
-		return take(ptr<T>(), 0);
-	}
-
-
-	// Cycle over iterator values.
+	// Iterable over [i, i + n).
 	template<class I>
-	class repeat {
-		I i, i0;
+	class counted<I, std::dynamic_extent> : public I {
+		std::size_t n;
 	public:
-		using iterator_category = std::input_iterator_tag;
+		using iterator_category = typename I::iterator_category;
 		using value_type = typename I::value_type;
 		using reference = typename I::reference;
 		using pointer = typename I::pointer;
 		using difference_type = typename I::difference_type;
 
-		constexpr repeat() = default;
-		constexpr repeat(I i)
-			: i(i), i0(i)
+		constexpr counted() = default;
+		constexpr counted(I i, std::size_t n)
+			: I(std::move(i)), n(n)
 		{ }
-		constexpr repeat(const repeat&) = default;
-		constexpr repeat& operator=(const repeat&) = default;
+		constexpr counted(const counted&) = default;
+		constexpr counted& operator=(const counted&) = default;
+		constexpr counted(counted&&) = default;
+		constexpr counted& operator=(counted&&) = default;
+		constexpr ~counted() = default;
+
+		/*constexpr*/ auto operator<=>(const counted& i) const = default;
+
+		void save(archive& a) const
+			requires savable<I>
+		{
+			fms::iterable::save(static_cast<const I&>(*this), a);
+			fms::iterable::save(n, a);
+		}
+		void load(archive& a)
+			requires savable<I>
+		{
+			fms::iterable::load(static_cast<I&>(*this), a);
+			fms::iterable::load(n, a);
+		}
+
+		constexpr counted begin() const
+		{
+			return counted(I::begin(), n);
+		}
+		constexpr counted end() const
+		{
+			return counted(drop(I::begin(), n), 0);
+		}
+
+		constexpr explicit operator bool() const noexcept
+		{
+			return n != 0;
+		}
+		// indirectly readable
+		constexpr decltype(auto) operator*() const noexcept
+		{
+			return I::operator*();
+		}
+		// indirectly writable
+		constexpr reference operator*() noexcept
+			requires std::indirectly_writable<I, value_type>
+		{
+			return I::operator*();
+		}
+		// weakly incrementable
+		constexpr counted& operator++() noexcept
+		{
+			if (operator bool()) {
+				I::operator++();
+				--n;
+			}
+
+			return *this;
+		}
+		// Only the count is checked.
+		template<class S>
+		constexpr bool for_each_until(S&& s)
+		{
+			for (; n; --n) {
+				if (!s(I::operator*())) {
+					return false;
+				}
+				I::operator++();
+			}
+
+			return true;
+		}
+		constexpr counted operator++(int) noexcept
+		{
+			auto tmp{ *this };
+
+			operator++();
+
+			return tmp;
+		}
+		// bidirectional
+		constexpr counted& operator--() noexcept
+			requires std::bidirectional_iterator<I>
+		{
+			I::operator--();
+			++n;
+
+			return *this;
+		}
+		constexpr counted operator--(int) noexcept
+			requires std::bidirectional_iterator<I>
+		{
+			auto tmp{ *this };
+
+			operator--();
+
+			return tmp;
+		}
+		// random access
+		constexpr counted& operator+=(difference_type d) noexcept
+			requires std::random_access_iterator<I>
+		{
+			I::operator+=(d);
+			n -= d;
+
+			return *this;
+		}
+		constexpr counted operator+(difference_type d) const noexcept
+			requires std::random_access_iterator<I>
+		{
+			return counted(I::operator+(d), n - d);
+		}
+		constexpr friend counted<I> operator+(std::ptrdiff_t d, counted<I> c) noexcept
+			requires std::random_access_iterator<I>
+		{
+			return c += d;
+		}
+		constexpr counted& operator-=(difference_type d) noexcept
+			requires std::random_access_iterator<I>
+		{
+			I::operator-=(d);
+			n += d;
+
+			return *this;
+		}
+		constexpr difference_type operator-(const counted& _i) const noexcept
+			requires std::random_access_iterator<I>
+		{
+			return I::operator-(_i);
+		}
+		constexpr counted operator-(difference_type d) const noexcept
+			requires std::random_access_iterator<I>
+		{
+			return counted(I::operator-(d), n + d);
+		}
+		constexpr reference operator[](difference_type d) const noexcept
+			requires std::random_access_iterator<I>
+		{
+			return I::operator[](d);
+		}
+		constexpr reference operator[](difference_type d) noexcept
+			requires std::random_access_iterator<I>
+		{
+			return I::operator[](d);
+		}
+	};
+
+	template<class I>
+	counted(I, std::size_t) -> counted<I>;
+
+	// Assumes lifetime of a.
+	template<class T, std::size_t N>
+	constexpr auto array(T(&a)[N]) noexcept
+	{
+		return counted(ptr(a), N);
+	}
+	// Assumes lifetime of a. Size is part of the type.
+	template<class T, std::size_t N>
+	constexpr auto fixed(T(&a)[N]) noexcept
+	{
+		return counted<ptr<T>, N>(ptr(a));
+	}
+
+	// Take at most n elements from i.
+	template<class I>
+	constexpr auto take(I i, std::iter_difference_t<I> n)
+	{
+		if constexpr (has_end<I>) {
+			n = std::min(n, size(i));
+		}
+
+		return counted(std::move(i), n);
+	}
+	// Take exactly N elements from i.
+	template<std::size_t N, class I>
+	constexpr auto take(I i)
+	{
+		return counted<I, N>(std::move(i));
+	}
+	// Iterable with no elements.
+	template<class T>
+	constexpr auto empty()
+	{
+		return take(ptr<T>(), 0);
+	}
+
+	// Elements are adjacent in memory.
+	template<class I>
+	struct is_contiguous : std::bool_constant<std::contiguous_iterator<I>> {};
+	template<class T>
+	struct is_contiguous<ptr<T>> : std::true_type {};
+	template<class I, std::size_t N>
+	struct is_contiguous<counted<I, N>> : is_contiguous<I> {};
+	template<class I>
+	struct is_contiguous<interval<I>> : is_contiguous<I> {};
+	template<class I>
+	inline constexpr bool is_contiguous_v = is_contiguous<I>::value;
+
+	// Buffer holding up to N elements inline that spills to the heap.
+	template<class T, std::size_t N>
+		requires (N > 0)
+	class small_buffer {
+		alignas(T) unsigned char buf[N * sizeof(T)];
+		std::size_t n; // inline elements
+		std::vector<T> heap; // all elements once spilled
+
+		T* slot(std::size_t k) noexcept
+		{
+			return std::launder(reinterpret_cast<T*>(buf)) + k;
+		}
+		const T* slot(std::size_t k) const noexcept
+		{
+			return std::launder(reinterpret_cast<const T*>(buf)) + k;
+		}
+		void destroy() noexcept
+		{
+			std::destroy_n(slot(0), n);
+			n = 0;
+		}
+	public:
+		using value_type = T;
+
+		small_buffer() noexcept
+			: n(0)
+		{ }
+		small_buffer(const small_buffer& b)
+			: n(0), heap(b.heap)
+		{
+			std::uninitialized_copy_n(b.slot(0), b.n, slot(0));
+			n = b.n;
+		}
+		small_buffer& operator=(const small_buffer& b)
+		{
+			if (this != &b) {
+				clear();
+				heap = b.heap;
+				std::uninitialized_copy_n(b.slot(0), b.n, slot(0));
+				n = b.n;
+			}
+
+			return *this;
+		}
+		small_buffer(small_buffer&& b) noexcept(std::is_nothrow_move_constructible_v<T>)
+			: n(0), heap(std::move(b.heap))
+		{
+			std::uninitialized_move_n(b.slot(0), b.n, slot(0));
+			n = b.n;
+			b.clear();
+		}
+		small_buffer& operator=(small_buffer&& b) noexcept(std::is_nothrow_move_constructible_v<T>)
+		{
+			if (this != &b) {
+				clear();
+				heap = std::move(b.heap);
+				std::uninitialized_move_n(b.slot(0), b.n, slot(0));
+				n = b.n;
+				b.clear();
+			}
+
+			return *this;
+		}
+		~small_buffer()
+		{
+			destroy();
+		}
+
+		static constexpr std::size_t capacity() noexcept
+		{
+			return N;
+		}
+		// Elements live on the heap.
+		bool spilled() const noexcept
+		{
+			return !heap.empty();
+		}
+		std::size_t size() const noexcept
+		{
+			return spilled() ? heap.size() : n;
+		}
+		T* data() noexcept
+		{
+			return spilled() ? heap.data() : slot(0);
+		}
+		const T* data() const noexcept
+		{
+			return spilled() ? heap.data() : slot(0);
+		}
+		T& operator[](std::size_t k) noexcept
+		{
+			return data()[k];
+		}
+		const T& operator[](std::size_t k) const noexcept
+		{
+			return data()[k];
+		}
+
+		// Iterable over elements. Invalidated by push_back.
+		auto view() noexcept
+		{
+			return counted(ptr(data()), size());
+		}
+		auto view() const noexcept
+		{
+			return counted(ptr(data()), size());
+		}
+
+		void push_back(T t)
+		{
+			if (spilled()) {
+				heap.push_back(std::move(t));
+			}
+			else if (n < N) {
+				std::construct_at(slot(n), std::move(t));
+				++n;
+			}
+			else {
+				heap.reserve(2 * N);
+				std::move(slot(0), slot(n), std::back_inserter(heap));
+				heap.push_back(std::move(t));
+				destroy();
+			}
+		}
+		void clear() noexcept
+		{
+			destroy();
+			heap.clear();
+		}
+	};
+
+	// Append only sequence of blocks holding B elements each. Elements never
+	// move, so iterators and pointers stay valid across push_back, and
+	// traversal runs a pointer loop per block.
+	template<class T, std::size_t B = std::bit_floor(std::max<std::size_t>(1, 4096 / sizeof(T)))>
+	class chunked_vector {
+		std::vector<std::vector<T>> bs; // each with capacity B
+		std::size_t n;
+
+		template<bool C>
+		class iter {
+			using V = std::conditional_t<C, const std::vector<std::vector<T>>, std::vector<std::vector<T>>>;
+			V* bs;
+			std::size_t k;
+		public:
+			using iterator_concept = std::random_access_iterator_tag;
+			using iterator_category = std::random_access_iterator_tag;
+			using value_type = T;
+			using reference = std::conditional_t<C, const T&, T&>;
+			using pointer = std::conditional_t<C, const T*, T*>;
+			using difference_type = std::ptrdiff_t;
+
+			iter() noexcept
+				: bs(nullptr), k(0)
+			{ }
+			explicit iter(V* bs, std::size_t k = 0) noexcept
+				: bs(bs), k(k)
+			{ }
+			operator iter<true>() const noexcept
+				requires (!C)
+			{
+				return iter<true>(bs, k);
+			}
+
+			bool operator==(const iter& i) const noexcept
+			{
+				return k == i.k;
+			}
+			auto operator<=>(const iter& i) const noexcept
+			{
+				return k <=> i.k;
+			}
+
+			// Elements left in this block.
+			std::size_t segment() const noexcept
+			{
+				return B - k % B;
+			}
+
+			reference operator*() const noexcept
+			{
+				return (*bs)[k / B][k % B];
+			}
+			pointer operator->() const noexcept
+			{
+				return std::addressof(operator*());
+			}
+			reference operator[](difference_type d) const noexcept
+			{
+				return *(*this + d);
+			}
+			iter& operator++() noexcept
+			{
+				++k;
+
+				return *this;
+			}
+			iter operator++(int) noexcept
+			{
+				auto tmp{ *this };
+
+				operator++();
+
+				return tmp;
+			}
+			iter& operator--() noexcept
+			{
+				--k;
+
+				return *this;
+			}
+			iter operator--(int) noexcept
+			{
+				auto tmp{ *this };
+
+				operator--();
+
+				return tmp;
+			}
+			iter& operator+=(difference_type d) noexcept
+			{
+				k += d;
+
+				return *this;
+			}
+			iter& operator-=(difference_type d) noexcept
+			{
+				k -= d;
+
+				return *this;
+			}
+			iter operator+(difference_type d) const noexcept
+			{
+				return iter(bs, k + d);
+			}
+			friend iter operator+(difference_type d, iter i) noexcept
+			{
+				return i + d;
+			}
+			iter operator-(difference_type d) const noexcept
+			{
+				return iter(bs, k - d);
+			}
+			difference_type operator-(const iter& i) const noexcept
+			{
+				return static_cast<difference_type>(k) - static_cast<difference_type>(i.k);
+			}
+		};
+	public:
+		using value_type = T;
+		using iterator = iter<false>;
+		using const_iterator = iter<true>;
+
+		static constexpr std::size_t block_size = B;
+
+		chunked_vector() noexcept
+			: n(0)
+		{ }
+		// Copies reserve B elements per block so later push_back never reallocates.
+		chunked_vector(const chunked_vector& c)
+			: n(c.n)
+		{
+			bs.reserve(c.bs.size());
+			for (const auto& b : c.bs) {
+				bs.emplace_back().reserve(B);
+				bs.back().insert(bs.back().end(), b.begin(), b.end());
+			}
+		}
+		chunked_vector& operator=(const chunked_vector& c)
+		{
+			if (this != &c) {
+				*this = chunked_vector(c);
+			}
+
+			return *this;
+		}
+		chunked_vector(chunked_vector&& c) noexcept
+			: bs(std::move(c.bs)), n(std::exchange(c.n, 0))
+		{ }
+		chunked_vector& operator=(chunked_vector&& c) noexcept
+		{
+			bs = std::move(c.bs);
+			n = std::exchange(c.n, 0);
+
+			return *this;
+		}
+		~chunked_vector() = default;
+
+		std::size_t size() const noexcept
+		{
+			return n;
+		}
+		bool empty() const noexcept
+		{
+			return n == 0;
+		}
+		T& operator[](std::size_t k) noexcept
+		{
+			return bs[k / B][k % B];
+		}
+		const T& operator[](std::size_t k) const noexcept
+		{
+			return bs[k / B][k % B];
+		}
+
+		void push_back(T t)
+		{
+			if (n % B == 0) {
+				bs.emplace_back().reserve(B);
+			}
+			bs.back().push_back(std::move(t));
+			++n;
+		}
+		void clear() noexcept
+		{
+			bs.clear();
+			n = 0;
+		}
+
+		iterator begin() noexcept
+		{
+			return iterator(&bs, 0);
+		}
+		iterator end() noexcept
+		{
+			return iterator(&bs, n);
+		}
+		const_iterator begin() const noexcept
+		{
+			return const_iterator(&bs, 0);
+		}
+		const_iterator end() const noexcept
+		{
+			return const_iterator(&bs, n);
+		}
+
+		// Number of blocks.
+		std::size_t blocks() const noexcept
+		{
+			return bs.size();
+		}
+		// Elements of block k.
+		auto block(std::size_t k) noexcept
+		{
+			return counted(ptr(bs[k].data()), bs[k].size());
+		}
+		auto block(std::size_t k) const noexcept
+		{
+			return counted(ptr(bs[k].data()), bs[k].size());
+		}
+	};
+
+	// Materialize i without allocating if it has at most N elements.
+	template<std::size_t N, class I, class T = std::iter_value_t<I>>
+	inline auto collect_small(I i)
+	{
+		small_buffer<T, N> b;
+		for_each_until(i, [&b](const auto& t) {
+			b.push_back(t);
+
+			return true;
+		});
+
+		return b;
+	}
+
+
+	// Cycle over iterator values.
+	template<class I>
+	class repeat {
+		I i, i0;
+	public:
+		using iterator_category = std::input_iterator_tag;
+		using value_type = typename I::value_type;
+		using reference = typename I::reference;
+		using pointer = typename I::pointer;
+		using difference_type = typename I::difference_type;
+
+		constexpr repeat() = default;
+		constexpr repeat(I i)
+			: i(i), i0(std::move(i))
+		{ }
+		constexpr repeat(const repeat&) = default;
+		constexpr repeat& operator=(const repeat&) = default;
 		constexpr repeat(repeat&&) = default;
 		constexpr repeat& operator=(repeat&&) = default;
 		constexpr ~repeat() = default;
 
-		constexpr auto operator<=>(const repeat& c) const = default;
+		constexpr auto operator<=>(const repeat& c) const = default;
+
+		void save(archive& a) const
+			requires savable<I>
+		{
+			fms::iterable::save(i, a);
+		}
+		void load(archive& a)
+			requires savable<I>
+		{
+			fms::iterable::load(i, a);
+		}
+
+		constexpr repeat begin() const
+		{
+			return *this;
+		}
+		// no end()
+
+		constexpr explicit operator bool() const noexcept
+		{
+			return valid(i); // repeat(empty) = empty
+		}
+		constexpr value_type operator*() const noexcept
+		{
+			return *i;
+		}
+		constexpr reference operator*() noexcept
+			requires std::indirectly_writable<I, value_type>
+		{
+			return *i;
+		}
+		constexpr repeat& operator++() noexcept
+		{
+			if (!++i) {
+				i = i0;
+			}
+
+			return *this;
+		}
+		constexpr repeat operator++(int) noexcept
+		{
+			auto tmp{ *this };
+
+			operator++();
+
+			return tmp;
+		}
+	};
+
+	template<class I>
+	constexpr auto rotate(I i, std::iter_difference_t<I> n)
+	{
+		return take(drop(repeat(i), n), size(i));
+	}
+
+	template<class T>
+	class constant {
+		T t;
+	public:
+		using iterator_category = std::random_access_iterator_tag;
+		using value_type = T;
+		using reference = T&;
+		using pointer = T*;
+		using difference_type = std::ptrdiff_t;
+
+		constexpr constant() = default;
+		constexpr constant(T t)
+			: t(t)
+		{ }
+		constexpr constant(const constant&) = default;
+		constexpr constant& operator=(const constant&) = default;
+		constexpr constant(constant&&) = default;
+		constexpr constant& operator=(constant&&) = default;
+		constexpr ~constant() = default;
+
+		constexpr auto operator<=>(const constant& c) const
+		{
+			return this <=> &c;
+		}
+
+		void save(archive& a) const
+			requires savable<T>
+		{
+			fms::iterable::save(t, a);
+		}
+		void load(archive& a)
+			requires savable<T>
+		{
+			fms::iterable::load(t, a);
+		}
+
+		constexpr constant begin() const
+		{
+			return *this;
+		}
+		// no end()
+
+		constexpr operator bool() const
+		{
+			return true;
+		}
+		constexpr value_type operator*() const
+		{
+			return t;
+		}
+		constexpr constant& operator++()
+		{
+			return *this;
+		}
+		constexpr constant operator++(int)
+		{
+			return *this;
+		}
+		// bidirectional
+		constexpr constant& operator--() noexcept
+		{
+			return *this;
+		}
+		constexpr constant operator--(int) noexcept
+		{
+			return *this;
+		}
+		// random access
+		constexpr constant& operator+=(difference_type)
+		{
+			return *this;
+		}
+		constexpr constant operator+(difference_type) const
+		{
+			return *this;
+		}
+		constexpr friend constant operator+(difference_type d, const constant& c)
+		{
+			return c;
+		}
+		constexpr constant& operator-=(difference_type)
+		{
+			return *this;
+		}
+		constexpr constant operator-(difference_type) const
+		{
+			return *this;
+		}
+		constexpr difference_type operator-(const constant&) const
+		{
+			return 0;
+		}
+		constexpr value_type operator[](difference_type) const
+		{
+			return t;
+		}
+		constexpr reference operator[](difference_type)
+		{
+			return t;
+		}
+	};
+
+	template<class T>
+	constexpr auto single(T t)
+	{
+		return take(constant<T>(t), 1);
+	}
+
+	// i0 then i1
+	template <class I0, class I1, class T = std::common_type_t<typename I0::value_type, typename I1::value_type>>
+	class concatenate2 {
+		I0 i0;
+		I1 i1;
+	public:
+		using iterator_category = std::input_iterator_tag;
+		using value_type = T;
+		using reference = T&;
+		using pointer = T*;
+		using difference_type = std::common_type_t<typename I0::difference_type, typename I1::difference_type>;
+
+		constexpr concatenate2() = default;
+		constexpr concatenate2(I0 i0, I1 i1)
+			: i0(std::move(i0)), i1(std::move(i1))
+		{ }
+		constexpr concatenate2(const concatenate2&) = default;
+		constexpr concatenate2& operator=(const concatenate2&) = default;
+		constexpr concatenate2(concatenate2&&) = default;
+		constexpr concatenate2& operator=(concatenate2&&) = default;
+		constexpr ~concatenate2() = default;
+
+		constexpr bool operator==(const concatenate2& i) const = default;
+
+		void save(archive& a) const
+			requires savable<I0> && savable<I1>
+		{
+			fms::iterable::save(i0, a);
+			fms::iterable::save(i1, a);
+		}
+		void load(archive& a)
+			requires savable<I0> && savable<I1>
+		{
+			fms::iterable::load(i0, a);
+			fms::iterable::load(i1, a);
+		}
+
+		constexpr auto begin() const
+		{
+			return *this;
+		}
+		constexpr auto end() const
+		{
+			return concatenate2(i0.end(), i1.end());
+		}
+
+		constexpr explicit operator bool() const
+		{
+			return valid(i0) || valid(i1);
+		}
+		constexpr value_type operator*() const
+		{
+			return valid(i0) ? *i0 : *i1;
+		}
+		constexpr concatenate2& operator++()
+		{
+			if (valid(i0)) {
+				++i0;
+			}
+			else {
+				++i1;
+			}
+
+			return *this;
+		}
+		template<class S>
+		constexpr bool for_each_until(S&& s)
+		{
+			return fms::iterable::for_each_until(i0, s) && fms::iterable::for_each_until(i1, s);
+		}
+		constexpr concatenate2 operator++(int) noexcept
+		{
+			auto tmp{ *this };
+
+			operator++();
+
+			return tmp;
+		}
+	};
+	template<class I>
+	constexpr auto concatenate(I&& i)
+	{
+		return std::forward<I>(i);
+	}
+	template<class I, class ...Is>
+	constexpr auto concatenate(I&& i, Is&&... is)
+	{
+		return concatenate2(std::forward<I>(i), concatenate(std::forward<Is>(is)...));
+	}
+
+	// Sorted i0 and i1 in order. Equivalent (!< and !>) elements are repeated.
+	template <class I0, class I1, class T = std::common_type_t<typename I0::value_type, typename I1::value_type>>
+	class merge2 {
+		I0 i0;
+		I1 i1;
+		bool _0; // true use i0, false use i1
+	public:
+		using iterator_category = std::input_iterator_tag;
+		using value_type = T;
+		using reference = T&;
+		using pointer = T*;
+		using difference_type = std::common_type_t<typename I0::difference_type, typename I0::difference_type>;
+
+		constexpr merge2() = default;
+		constexpr merge2(I0 _i0, I1 _i1)
+			: i0(std::move(_i0)), i1(std::move(_i1))
+		{
+			if (valid(i0) && valid(i1)) {
+				if (*i1 < *i0) {
+					_0 = false;
+				}
+				else { // less or equivalent
+					_0 = true;
+				}
+			}
+			else if (valid(i0)) {
+				_0 = true;
+			}
+			else {
+				_0 = false;
+			}
+		}
+		constexpr merge2(const merge2&) = default;
+		constexpr merge2& operator=(const merge2&) = default;
+		constexpr merge2(merge2&&) = default;
+		constexpr merge2& operator=(merge2&&) = default;
+		constexpr ~merge2() = default;
+
+		constexpr bool operator==(const merge2& i) const = default;
+
+		void save(archive& a) const
+			requires savable<I0> && savable<I1>
+		{
+			fms::iterable::save(i0, a);
+			fms::iterable::save(i1, a);
+			fms::iterable::save(_0, a);
+		}
+		void load(archive& a)
+			requires savable<I0> && savable<I1>
+		{
+			fms::iterable::load(i0, a);
+			fms::iterable::load(i1, a);
+			fms::iterable::load(_0, a);
+		}
+
+		constexpr auto begin() const
+		{
+			return *this;
+		}
+		constexpr auto end() const
+		{
+			return merge2(i0.end(), i1.end());
+		}
+
+		constexpr explicit operator bool() const
+		{
+			return valid(i0) || valid(i1);
+		}
+		constexpr value_type operator*() const
+		{
+			if (valid(i0) && valid(i1)) {
+				if (*i0 < *i1) {
+					return *i0;
+				}
+				else if (*i1 < *i0) {
+					return *i1;
+				}
+				else {
+					return _0 ? *i0 : *i1;
+				}
+			}
+
+			return valid(i0) ? *i0 : *i1;
+		}
+		constexpr merge2& operator++()
+		{
+			if (valid(i0) && valid(i1)) {
+				if (*i0 < *i1) {
+					++i0;
+				}
+				else if (*i1 < *i0) {
+					++i1;
+				}
+				else { // equivalent
+					if (_0) {
+						++i0;
+					}
+					else {
+						++i1;
+					}
+					_0 = !_0; // switch
+				}
+			}
+			else {
+				if (valid(i0)) {
+					++i0;
+					_0 = true;
+				}
+				else if (valid(i1)) {
+					++i1;
+					_0 = false;
+				}
+			}
+
+
+			return *this;
+		}
+		constexpr merge2 operator++(int) noexcept
+		{
+			auto tmp{ *this };
+
+			operator++();
+
+			return tmp;
+		}
+	};
+	template<class I>
+	constexpr auto merge(I&& i)
+	{
+		return std::forward<I>(i);
+	}
+	template<class I, class ...Is>
+	constexpr auto merge(I&& i, Is&&... is)
+	{
+		return merge2(std::forward<I>(i), merge(std::forward<Is>(is)...));
+	}
+
+	// copy assignable function object
+	// Trivially copyable callables such as captureless lambdas, function pointers,
+	// and std::reference_wrapper are held by value.
+	template<class F>
+	class copy_assignable {
+		std::optional<F> f;
+	public:
+		constexpr copy_assignable() noexcept = default;
+		constexpr copy_assignable(F f) noexcept
+			: f(std::move(f))
+		{ }
+		copy_assignable(const copy_assignable& a)
+		{
+			f.reset();
+			if (a.f.has_value()) {
+				f.emplace(a.f.value());
+			}
+		}
+		copy_assignable& operator=(const copy_assignable& a)
+		{
+			if (this != &a) {
+				f.reset();
+				if (a.f.has_value()) {
+					f.emplace(a.f.value());
+				}
+			}
+
+			return *this;
+		}
+		copy_assignable(copy_assignable&&) = default;
+		copy_assignable& operator=(copy_assignable&&) = default;
+		~copy_assignable() = default;
+
+		template<class... Args>
+		constexpr auto operator()(Args&&... args) const
+		{
+			return f.has_value() ? f.value()(std::forward<Args>(args)...) : decltype(f.value()(std::forward<Args>(args)...)){};
+		}
+	};
+	// Callables that are expensive to copy, e.g. lambdas capturing a vector,
+	// are shared by all copies. Calls are const so sharing is not observable.
+	template<class F>
+		requires (!std::is_trivially_copyable_v<F>)
+	class copy_assignable<F> {
+		std::shared_ptr<const F> f;
+	public:
+		copy_assignable() noexcept = default;
+		copy_assignable(F f)
+			: f(std::make_shared<const F>(std::move(f)))
+		{ }
+		copy_assignable(const copy_assignable&) = default;
+		copy_assignable& operator=(const copy_assignable&) = default;
+		copy_assignable(copy_assignable&&) = default;
+		copy_assignable& operator=(copy_assignable&&) = default;
+		~copy_assignable() = default;
+
+		template<class... Args>
+		auto operator()(Args&&... args) const
+		{
+			return f ? (*f)(std::forward<Args>(args)...) : decltype((*f)(std::forward<Args>(args)...)){};
+		}
+	};
+
+	// Apply a function to elements of an iterable.
+	template <class F, class I>
+	class apply {
+		using T = std::iter_value_t<I>;
+		using U = std::invoke_result_t<F, T>;
+
+		copy_assignable<F> f; // for operator=(const apply&)
+		I i;
+	public:
+		using iterator_category = std::input_iterator_tag;
+		using value_type = U;
+		using reference = U&;
+		using pointer = U*;
+		using difference_type = typename I::difference_type;
+
+		constexpr apply() = default;
+		constexpr apply(F f, I i)
+			: f(std::move(f)), i(std::move(i))
+		{ }
+		constexpr apply(const apply& a) = default;
+		constexpr apply& operator=(const apply& a) = default;
+		constexpr apply(apply&& a) = default;
+		constexpr apply& operator=(apply&& a) = default;
+		constexpr ~apply() = default;
+
+		constexpr bool operator==(const apply& a) const
+		{
+			return i == a.i; // F is part of type
+		}
+
+		void save(archive& a) const
+			requires savable<I>
+		{
+			fms::iterable::save(i, a);
+		}
+		void load(archive& a)
+			requires savable<I>
+		{
+			fms::iterable::load(i, a);
+		}
+
+		constexpr explicit operator bool() const
+		{
+			return valid(i);
+		}
+		constexpr value_type operator*() const
+		{
+			return f(*i);
+		}
+		constexpr apply& operator++() noexcept
+		{
+			++i;
+
+			return *this;
+		}
+		template<class S>
+		constexpr bool for_each_until(S&& s)
+		{
+			return fms::iterable::for_each_until(i, [&](const auto& t) { return s(f(t)); });
+		}
+		constexpr apply operator++(int) noexcept
+		{
+			auto tmp{ *this };
+
+			operator++();
+
+			return tmp;
+		}
+	};
+
+	// Apply a binary operation to elements of two iterable.
+	template <class BinOp, class I0, class I1>
+	class binop {
+		using T0 = std::iter_value_t<I0>;
+		using T1 = std::iter_value_t<I1>;
+		using T = std::invoke_result_t<BinOp, T0, T1>;
+		
+		copy_assignable<BinOp> op;
+		I0 i0;
+		I1 i1;
+		public:
+			using iterator_category = std::input_iterator_tag;
+			using value_type = T;
+			using reference = T&;
+			using difference_type = std::ptrdiff_t;
+
+			constexpr binop(BinOp op, I0 i0, I1 i1)
+				: op(std::move(op)), i0(std::move(i0)), i1(std::move(i1))
+			{ }
+			constexpr binop(const binop& o) = default;
+			constexpr binop& operator=(const binop& o) = default;
+			constexpr binop(binop&& o) noexcept = default;
+			constexpr binop& operator=(binop&& o) = default;
+			constexpr ~binop() = default;
+
+			constexpr bool operator==(const binop& o) const
+			{
+				return i0 == o.i0 && i1 == o.i1;
+			}
+
+			void save(archive& a) const
+				requires savable<I0> && savable<I1>
+			{
+				fms::iterable::save(i0, a);
+				fms::iterable::save(i1, a);
+			}
+			void load(archive& a)
+				requires savable<I0> && savable<I1>
+			{
+				fms::iterable::load(i0, a);
+				fms::iterable::load(i1, a);
+			}
+
+			constexpr explicit operator bool() const
+			{
+				return valid(i0) && valid(i1);
+			}
+			constexpr value_type operator*() const
+			{
+				return op(*i0, *i1);
+			}
+			constexpr binop& operator++() noexcept
+			{
+				++i0;
+				++i1;
+
+				return *this;
+			}
+			// Only i1 is checked in the loop over i0.
+			template<class S>
+			constexpr bool for_each_until(S&& s)
+			{
+				bool go = true;
+				fms::iterable::for_each_until(i0, [&](const auto& t0) {
+					if (!valid(i1)) {
+						return false;
+					}
+					go = s(op(t0, *i1));
+					++i1;
+
+					return go;
+				});
+
+				return go;
+			}
+			constexpr binop operator++(int) noexcept
+			{
+				auto b{ *this };
+
+				operator++();
+
+				return b;
+			}
+	};
+
+
+	// Elements satisfying predicate.
+	template <class P, class I>
+	class filter {
+		using T = std::iter_value_t<I>;
+
+		copy_assignable<P> p;
+		I i;
+
+		constexpr void next()
+		{
+			while (i && !p(*i)) {
+				++i;
+			}
+		}
+	public:
+		using iterator_category = std::input_iterator_tag;
+		using value_type = T;
+		using reference = T&;
+		using pointer = T*;
+		using difference_type = typename I::difference_type;
+
+		constexpr filter() = default;
+		constexpr filter(P p, I i)
+			: p(std::move(p)), i(std::move(i))
+		{
+			next();
+		}
+		constexpr filter(const filter& a) = default;
+		constexpr filter& operator=(const filter& a) = default;
+		constexpr filter(filter&& a) = default;
+		constexpr filter& operator=(filter&& a) = default;
+		constexpr ~filter() = default;
+
+		constexpr bool operator==(const filter& a) const
+		{
+			return i == a.i; // P is part of type
+		}
+
+		void save(archive& a) const
+			requires savable<I>
+		{
+			fms::iterable::save(i, a);
+		}
+		void load(archive& a)
+			requires savable<I>
+		{
+			fms::iterable::load(i, a);
+		}
+
+		constexpr explicit operator bool() const
+		{
+			return valid(i);
+		}
+		constexpr value_type operator*() const
+		{
+			return *i;
+		}
+		constexpr filter& operator++() noexcept
+		{
+			++i;
+			next();
+
+			return *this;
+		}
+		template<class S>
+		constexpr bool for_each_until(S&& s)
+		{
+			return fms::iterable::for_each_until(i, [&](const auto& t) { return !p(t) || s(t); });
+		}
+		constexpr filter operator++(int) noexcept
+		{
+			auto tmp{ *this };
+
+			operator++();
+
+			return tmp;
+		}
+	};
+
+	// Stop at first element satisfying predicate.
+	template <class P, class I, class T = typename I::value_type>
+	class until {
+		copy_assignable<P> p;
+		I i;
+	public:
+		using iterator_category = std::input_iterator_tag;
+		using value_type = T;
+		using reference = T&;
+		using pointer = T*;
+		using difference_type = typename I::difference_type;
+
+		constexpr until() = default;
+		constexpr until(P p, I i)
+			: p(std::move(p)), i(std::move(i))
+		{ }
+		constexpr until(const until&) = default;
+		constexpr until& operator=(const until&) = default;
+		constexpr until(until&&) = default;
+		constexpr until& operator=(until&&) = default;
+		constexpr ~until() = default;
+
+		constexpr bool operator==(const until& u) const
+		{
+			return i == u.i;
+		}
+
+		void save(archive& a) const
+			requires savable<I>
+		{
+			fms::iterable::save(i, a);
+		}
+		void load(archive& a)
+			requires savable<I>
+		{
+			fms::iterable::load(i, a);
+		}
+
+		constexpr explicit operator bool() const
+		{
+			return i && !p(*i);
+		}
+		constexpr value_type operator*() const
+		{
+			return *i;
+		}
+		constexpr until& operator++() noexcept
+		{
+			++i;
+
+			return *this;
+		}
+		template<class S>
+		constexpr bool for_each_until(S&& s)
+		{
+			bool go = true;
+			fms::iterable::for_each_until(i, [&](const auto& t) {
+				return !p(t) && (go = s(t));
+			});
+
+			return go;
+		}
+		constexpr until operator++(int) noexcept
+		{
+			auto tmp{ *this };
+
+			operator++();
+
+			return tmp;
+		}
+	};
+
+	// Right fold: of op
+	template <class BinOp, class I, class T = typename I::value_type>
+	class fold {
+		copy_assignable<BinOp> op;
+		I i;
+		T t;
+	public:
+		using iterator_category = std::input_iterator_tag;
+		using value_type = T;
+		using reference = T&;
+		using pointer = T*;
+		using difference_type = std::ptrdiff_t;
+
+		constexpr fold() = default;
+		constexpr fold(BinOp op, I i, T t = 0)
+			: op(std::move(op)), i(std::move(i)), t(std::move(t))
+		{ }
+		constexpr fold(const fold& f) = default;
+		constexpr fold& operator=(const fold& f) = default;
+		constexpr fold(fold&& f) = default;
+		constexpr fold& operator=(fold&& f) noexcept = default;
+		constexpr ~fold() = default;
+
+		constexpr bool operator==(const fold& f) const
+		{
+			return i == f.i && t == f.t;
+		}
+
+		void save(archive& a) const
+			requires savable<I> && savable<T>
+		{
+			fms::iterable::save(i, a);
+			fms::iterable::save(t, a);
+		}
+		void load(archive& a)
+			requires savable<I> && savable<T>
+		{
+			fms::iterable::load(i, a);
+			fms::iterable::load(t, a);
+		}
+
+		constexpr explicit operator bool() const
+		{
+			return valid(i);
+		}
+		constexpr value_type operator*() const noexcept
+		{
+			return t;
+		}
+		constexpr fold& operator++() noexcept
+		{
+			if (i) {
+				t = op(t, *i);
+				++i;
+			}
+
+			return *this;
+		}
+		template<class S>
+		constexpr bool for_each_until(S&& s)
+		{
+			return fms::iterable::for_each_until(i, [&](const auto& u) {
+				if (!s(t)) {
+					return false;
+				}
+				t = op(t, u);
+
+				return true;
+			});
+		}
+		constexpr fold operator++(int) noexcept
+		{
+			auto tmp{ *this };
+
+			operator++();
+
+			return tmp;
+		}
+	};
+
+	template <class I, class T = typename I::value_type>
+	inline auto sum(I i, T t = 0)
+	{
+		for_each_until(i, [&t](const auto& u) {
+			t += u;
+
+			return true;
+		});
+
+		return t;
+	}
+
+	template <class I, class T = typename I::value_type>
+	inline auto prod(I i, T t = 1)
+	{
+		for_each_until(i, [&t](const auto& u) {
+			t *= u;
+
+			return true;
+		});
+
+		return t;
+	}
+
+	// Combine block results pairwise in a fixed tree.
+	template<class T, class Op>
+	inline T block_combine(std::vector<T>& r, Op op, T t)
+	{
+		if (r.empty()) {
+			return t;
+		}
+		for (std::size_t m = r.size(); m > 1; m = (m + 1) / 2) {
+			for (std::size_t j = 0; j < m / 2; ++j) {
+				r[j] = op(r[2 * j], r[2 * j + 1]);
+			}
+			if (m % 2) {
+				r[m / 2] = r[m - 1];
+			}
+		}
+
+		return r[0];
+	}
+	// Reproducible reduction. Apply op to blocks of b consecutive elements,
+	// then combine block results pairwise in a fixed tree. The result depends
+	// only on i, op, t, and b, so par_block_reduce gives bitwise identical
+	// results for any number of threads. t must be the identity of op.
+	// Use b = 0 for a single block.
+	// Costs about n/b extra op calls and an array of n/b partial results.
+	// Floating point results are reproducible only without -ffast-math.
+	template<class I, class Op, class T = typename I::value_type>
+	inline T block_reduce(I i, Op op, T t = 0, std::size_t b = 1024)
+	{
+		std::vector<T> r;
+		T u = t;
+		std::size_t k = 0;
+		for_each_until(i, [&](const auto& v) {
+			u = op(u, v);
+			if (++k == b) {
+				r.push_back(u);
+				u = t;
+				k = 0;
+			}
+
+			return true;
+		});
+		if (k) {
+			r.push_back(u);
+		}
+
+		return block_combine(r, op, t);
+	}
+	// Block i[k b, (k + 1) b) is reduced by thread k mod threads.
+	template<class I, class Op, class T = typename I::value_type>
+		requires has_end<I> && std::random_access_iterator<I>
+	inline T par_block_reduce(I i, Op op, T t = 0, std::size_t threads = 1, std::size_t b = 1024)
+	{
+		const auto n = static_cast<std::size_t>(size(i));
+		if (b == 0) {
+			b = std::max<std::size_t>(n, 1);
+		}
+		std::vector<T> r((n + b - 1) / b, t);
+		threads = std::max<std::size_t>(1, std::min(threads, r.size()));
+
+		const auto reduce = [&](std::size_t k0) {
+			for (std::size_t k = k0; k < r.size(); k += threads) {
+				FMS_ITERABLE_SPAN("par_block_reduce", "chunk");
+				auto c = take(drop(i, k * b), b);
+				for_each_until(c, [&](const auto& v) {
+					r[k] = op(r[k], v);
+
+					return true;
+				});
+			}
+		};
+		std::vector<std::thread> ts;
+		for (std::size_t k = 1; k < threads; ++k) {
+			ts.emplace_back(reduce, k);
+		}
+		reduce(0);
+		for (auto& th : ts) {
+			th.join();
+		}
+
+		return block_combine(r, op, t);
+	}
+
+	// d(i[1], i[0]), d(i[2], i[1]), ...
+	template <class I, class T = typename I::value_type, class D = std::minus<T>, 
+		typename U = std::invoke_result_t<D, T, T>>
+	class delta {
+		copy_assignable<D> d;
+		I i;
+		T t;
+	public:
+		using iterator_category = std::input_iterator_tag;
+		using value_type = U;
+		using reference = U&;
+		using pointer = U*;
+		using difference_type = std::ptrdiff_t;
+
+		constexpr delta() = default;
+		constexpr delta(I _i, D _d = std::minus<T>{})
+			: d(std::move(_d)), i(std::move(_i)), t{}
+		{
+			if (i) {
+				t = *i;
+				++i;
+			}
+		}
+		constexpr delta(const delta& _d) = default;
+		constexpr delta& operator=(const delta& _d) = default;
+		constexpr delta(delta&& _d) = default;
+		constexpr delta& operator=(delta&& _d) = default;
+		constexpr ~delta() = default;
 
-		constexpr repeat begin() const
+		constexpr bool operator==(const delta& _d) const
+		{
+			return i == _d.i && t == _d.t;
+		}
+
+		void save(archive& a) const
+			requires savable<I> && savable<T>
+		{
+			fms::iterable::save(i, a);
+			fms::iterable::save(t, a);
+		}
+		void load(archive& a)
+			requires savable<I> && savable<T>
+		{
+			fms::iterable::load(i, a);
+			fms::iterable::load(t, a);
+		}
+
+		constexpr explicit operator bool() const
+		{
+			return valid(i);
+		}
+		constexpr value_type operator*() const
+		{
+			return d(*i, t);
+		}
+		constexpr delta& operator++() noexcept
 		{
+			if (i) {
+				t = *i;
+				++i;
+			}
+
 			return *this;
 		}
-		// no end()
+		template<class S>
+		constexpr bool for_each_until(S&& s)
+		{
+			return fms::iterable::for_each_until(i, [&](const auto& u) {
+				const bool go = s(d(u, t));
+				t = u;
+
+				return go;
+			});
+		}
+		constexpr delta operator++(int) noexcept
+		{
+			auto tmp{ *this };
+
+			operator++();
+
+			return tmp;
+		}
+	};
+
+	// uptick + downtick = delta
+	template <class I, class T = typename I::value_type>
+	inline auto uptick(I i)
+	{
+		return delta(std::move(i), [](T a, T b) { return std::max<T>(b - a, 0); });
+	}
+	template <class I, class T = typename I::value_type>
+	inline auto downtick(I i)
+	{
+		return delta(std::move(i), [](T a, T b) { return std::min<T>(b - a, 0); });
+	}
+
+	template<class... Is>
+	class tuple {
+		std::tuple<Is...> is;
+	public:
+		using iterator_category = std::input_iterator_tag;
+		using value_type = std::tuple<typename Is::value_type...>;
+		using reference = value_type&;
+		using difference_type = std::ptrdiff_t;
+
+		constexpr tuple(Is... is)
+			: is(std::move(is)...)
+		{ }
+		constexpr tuple(const tuple&) = default;
+		constexpr tuple& operator=(const tuple&) = default;
+		constexpr tuple(tuple&&) = default;
+		constexpr tuple& operator=(tuple&&) = default;
+		constexpr ~tuple() = default;
+
+		constexpr bool operator==(const tuple& t) const = default;
+
+		void save(archive& a) const
+			requires (savable<Is> && ...)
+		{
+			std::apply([&a](const auto&... i) { (fms::iterable::save(i, a), ...); }, is);
+		}
+		void load(archive& a)
+			requires (savable<Is> && ...)
+		{
+			std::apply([&a](auto&... i) { (fms::iterable::load(i, a), ...); }, is);
+		}
+
+		constexpr explicit operator bool() const
+		{
+			return std::apply([](const auto&... i) { return (valid(i) && ...); }, is);
+		}
+		constexpr value_type operator*() const
+		{
+			return std::apply([](auto... i) { return std::make_tuple(*i...); }, is);
+		}
+		constexpr tuple& operator++() noexcept
+		{
+			std::apply([](auto&... i) { (++i, ...); }, is);
+
+			return *this;
+		}
+		constexpr tuple operator++(int) noexcept
+		{
+			auto tmp{ *this };
+
+			operator++();
+
+			return tmp;
+		}
+	};
+
+	template<class C>
+	struct is_infinite<back_insert_iterable<C>> : std::true_type {};
+	template<class C>
+	struct is_infinite<front_insert_iterable<C>> : std::true_type {};
+	template<class T>
+	struct is_infinite<iota<T>> : std::true_type {};
+	template<class T>
+	struct is_infinite<power<T>> : std::true_type {};
+	template<class T>
+	struct is_infinite<factorial<T>> : std::true_type {};
+	template<class T>
+	struct is_infinite<constant<T>> : std::true_type {};
+	template<class I>
+	struct is_infinite<repeat<I>> : is_infinite<I> {};
+	template<class I0, class I1, class T>
+	struct is_infinite<concatenate2<I0, I1, T>> : std::bool_constant<is_infinite_v<I0> || is_infinite_v<I1>> {};
+	template<class I0, class I1, class T>
+	struct is_infinite<merge2<I0, I1, T>> : std::bool_constant<is_infinite_v<I0> || is_infinite_v<I1>> {};
+	template<class F, class I>
+	struct is_infinite<apply<F, I>> : is_infinite<I> {};
+	template<class BinOp, class I0, class I1>
+	struct is_infinite<binop<BinOp, I0, I1>> : std::bool_constant<is_infinite_v<I0> && is_infinite_v<I1>> {};
+	template<class BinOp, class I, class T>
+	struct is_infinite<fold<BinOp, I, T>> : is_infinite<I> {};
+	template<class I, class T, class D, class U>
+	struct is_infinite<delta<I, T, D, U>> : is_infinite<I> {};
+	template<class... Is>
+	struct is_infinite<tuple<Is...>> : std::bool_constant<(is_infinite_v<Is> && ...)> {};
+
+	// Consecutive batches of at most n elements copied into a reused buffer.
+	template<class I>
+	class chunk {
+		using T = std::iter_value_t<I>;
+
+		I i;
+		std::size_t n;
+		std::vector<T> buf;
+
+		constexpr void next()
+		{
+			buf.clear();
+			while (buf.size() < n && i) {
+				buf.push_back(*i);
+				++i;
+			}
+		}
+	public:
+		using iterator_category = std::input_iterator_tag;
+		using value_type = counted<ptr<const T>>;
+		using reference = value_type&;
+		using pointer = value_type*;
+		using difference_type = std::ptrdiff_t;
+
+		constexpr chunk() = default;
+		constexpr chunk(I i, std::size_t n)
+			: i(std::move(i)), n(n)
+		{
+			buf.reserve(n);
+			next();
+		}
+		constexpr chunk(const chunk&) = default;
+		constexpr chunk& operator=(const chunk&) = default;
+		constexpr chunk(chunk&&) = default;
+		constexpr chunk& operator=(chunk&&) = default;
+		constexpr ~chunk() = default;
+
+		constexpr bool operator==(const chunk& c) const
+		{
+			return i == c.i && buf.size() == c.buf.size();
+		}
+
+		constexpr chunk begin() const
+		{
+			return *this;
+		}
+		constexpr chunk end() const
+			requires has_end<I>
+		{
+			return chunk(i.end(), n);
+		}
 
 		constexpr explicit operator bool() const noexcept
 		{
-			return i.operator bool(); // repeat(empty) = empty
+			return !buf.empty();
 		}
+		// Valid until the next increment.
 		constexpr value_type operator*() const noexcept
 		{
-			return *i;
+			return value_type(ptr<const T>(buf.data()), buf.size());
 		}
-		constexpr reference operator*() noexcept
-			requires std::indirectly_writable<I, value_type>
+		constexpr chunk& operator++()
 		{
-			return *i;
+			next();
+
+			return *this;
 		}
-		constexpr repeat& operator++() noexcept
+		constexpr chunk operator++(int)
 		{
-			if (!++i) {
-				i = i0;
+			auto tmp{ *this };
+
+			operator++();
+
+			return tmp;
+		}
+	};
+
+	// Adjacent elements with a known end can be viewed in place.
+	template<class I>
+	concept contiguous_view = is_contiguous_v<I> && has_end<I>
+		&& std::is_lvalue_reference_v<std::iter_reference_t<I>>;
+
+	// Zero copy batches of at most n adjacent elements.
+	template<class I>
+		requires contiguous_view<I>
+	class chunk<I> {
+		using T = std::remove_reference_t<std::iter_reference_t<I>>;
+
+		T* p;
+		std::size_t m; // remaining
+		std::size_t n;
+	public:
+		using iterator_category = std::input_iterator_tag;
+		using value_type = counted<ptr<T>>;
+		using reference = value_type&;
+		using pointer = value_type*;
+		using difference_type = std::ptrdiff_t;
+
+		constexpr chunk() = default;
+		constexpr chunk(I i, std::size_t n)
+			: p(i ? &*i : nullptr), m(i ? static_cast<std::size_t>(size(i)) : 0), n(n)
+		{ }
+		constexpr chunk(const chunk&) = default;
+		constexpr chunk& operator=(const chunk&) = default;
+		constexpr chunk(chunk&&) = default;
+		constexpr chunk& operator=(chunk&&) = default;
+		constexpr ~chunk() = default;
+
+		constexpr bool operator==(const chunk& c) const = default;
+
+		constexpr chunk begin() const
+		{
+			return *this;
+		}
+		constexpr chunk end() const
+		{
+			auto e{ *this };
+			e.p += e.m;
+			e.m = 0;
+
+			return e;
+		}
+
+		constexpr explicit operator bool() const noexcept
+		{
+			return n != 0 && m != 0;
+		}
+		constexpr value_type operator*() const noexcept
+		{
+			return value_type(ptr<T>(p), std::min(n, m));
+		}
+		constexpr chunk& operator++() noexcept
+		{
+			const auto k = std::min(n, m);
+			p += k;
+			m -= k;
+
+			return *this;
+		}
+		constexpr chunk operator++(int) noexcept
+		{
+			auto tmp{ *this };
+
+			operator++();
+
+			return tmp;
+		}
+	};
+
+	// Tokens of s separated by any character in d. Assumes lifetime of s.
+	// An empty s has no tokens and adjacent delimiters give empty tokens.
+	class split {
+		static constexpr std::size_t N = 16; // delimiters compared in parallel
+
+		const char* b; // current token
+		const char* t; // end of current token
+		const char* e; // end of s
+		std::size_t nd;
+		char ds[N];
+		std::uint64_t set[4]; // 256 bit membership
+
+		bool is_delim(char c) const noexcept
+		{
+			const auto u = static_cast<unsigned char>(c);
+
+			return (set[u >> 6] >> (u & 63)) & 1;
+		}
+		const char* find(const char* p) const noexcept
+		{
+			if (nd == 1) {
+				const void* q = std::memchr(p, ds[0], e - p);
+
+				return q ? static_cast<const char*>(q) : e;
+			}
+#ifdef FMS_ITERABLE_SSE2
+			if (nd != 0 && nd <= N) {
+				for (; e - p >= 16; p += 16) {
+					const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+					__m128i m = _mm_setzero_si128();
+					for (std::size_t k = 0; k < nd; ++k) {
+						m = _mm_or_si128(m, _mm_cmpeq_epi8(x, _mm_set1_epi8(ds[k])));
+					}
+					if (const int mask = _mm_movemask_epi8(m)) {
+						return p + std::countr_zero(static_cast<unsigned>(mask));
+					}
+				}
+			}
+#endif
+			while (p != e && !is_delim(*p)) {
+				++p;
+			}
+
+			return p;
+		}
+	public:
+		using iterator_category = std::input_iterator_tag;
+		using value_type = std::string_view;
+		using reference = std::string_view;
+		using pointer = const std::string_view*;
+		using difference_type = std::ptrdiff_t;
+
+		split(std::string_view s, std::string_view d)
+			: b(s.data()), t(nullptr), e(s.data() + s.size()), nd(d.size()), ds{}, set{}
+		{
+			for (std::size_t k = 0; k < d.size(); ++k) {
+				const auto u = static_cast<unsigned char>(d[k]);
+				set[u >> 6] |= std::uint64_t(1) << (u & 63);
+				if (k < N) {
+					ds[k] = d[k];
+				}
+			}
+			if (s.empty()) {
+				b = nullptr;
+			}
+			else {
+				t = find(b);
+			}
+		}
+		split(std::string_view s, char d)
+			: split(s, std::string_view(&d, 1))
+		{ }
+		split(const split&) = default;
+		split& operator=(const split&) = default;
+		split(split&&) = default;
+		split& operator=(split&&) = default;
+		~split() = default;
+
+		bool operator==(const split& s) const
+		{
+			return b == s.b && (b == nullptr || t == s.t);
+		}
+
+		split begin() const
+		{
+			return *this;
+		}
+		split end() const
+		{
+			auto s{ *this };
+			s.b = nullptr;
+
+			return s;
+		}
+
+		explicit operator bool() const noexcept
+		{
+			return b != nullptr;
+		}
+		value_type operator*() const noexcept
+		{
+			return value_type(b, t - b);
+		}
+		split& operator++() noexcept
+		{
+			if (b) {
+				if (t == e) {
+					b = nullptr;
+				}
+				else {
+					b = t + 1;
+					t = find(b);
+				}
 			}
 
 			return *this;
 		}
-		constexpr repeat operator++(int) noexcept
+		split operator++(int) noexcept
 		{
 			auto tmp{ *this };
 
@@ -823,162 +3138,521 @@ namespace fms::iterable {
 		}
 	};
 
-	template<class I>
-	constexpr auto rotate(I i, std::iter_difference_t<I> n)
+	// 64 bit finalizer to spread poor hashes such as std::hash<int>.
+	constexpr std::uint64_t hash_mix(std::uint64_t h) noexcept
 	{
-		return take(drop(repeat(i), n), size(i));
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdULL;
+		h ^= h >> 33;
+		h *= 0xc4ceb9fe1a85ec53ULL;
+		h ^= h >> 33;
+
+		return h;
 	}
 
-	template<class T>
-	class constant {
-		T t;
+	// Open addressing map from keys to dense ids in insertion order.
+	// Slots hold a 32 bit hash tag and the id so probes rarely touch keys.
+	template<class K, class Hash = std::hash<K>, class Eq = std::equal_to<K>>
+	class flat_index {
+		std::vector<K> keys;
+		std::vector<std::uint64_t> slots; // tag << 32 | (id + 1), 0 is empty
+		[[no_unique_address]] Hash hash;
+		[[no_unique_address]] Eq eq;
+
+		static constexpr std::uint64_t tag_mask = 0xFFFFFFFF00000000ULL;
+
+		std::uint64_t hash_of(const K& k) const
+		{
+			return hash_mix(static_cast<std::uint64_t>(hash(k)));
+		}
+		void place(std::uint64_t h, std::size_t id)
+		{
+			const std::size_t mask = slots.size() - 1;
+			std::size_t j = h & mask;
+			while (slots[j]) {
+				j = (j + 1) & mask;
+			}
+			slots[j] = (h & tag_mask) | (id + 1);
+		}
+		// Keep load factor at most 1/2.
+		void grow(std::size_t n)
+		{
+			std::size_t m = slots.empty() ? 16 : slots.size();
+			while (m < 2 * n) {
+				m *= 2;
+			}
+			if (m != slots.size()) {
+				slots.assign(m, 0);
+				for (std::size_t id = 0; id < keys.size(); ++id) {
+					place(hash_of(keys[id]), id);
+				}
+			}
+		}
 	public:
-		using iterator_category = std::random_access_iterator_tag;
-		using value_type = T;
-		using reference = T&;
-		using pointer = T*;
-		using difference_type = std::ptrdiff_t;
+		static constexpr std::size_t npos = static_cast<std::size_t>(-1);
 
-		constexpr constant() = default;
-		constexpr constant(T t)
-			: t(t)
+		flat_index(Hash hash = Hash{}, Eq eq = Eq{})
+			: hash(std::move(hash)), eq(std::move(eq))
 		{ }
-		constexpr constant(const constant&) = default;
-		constexpr constant& operator=(const constant&) = default;
-		constexpr constant(constant&&) = default;
-		constexpr constant& operator=(constant&&) = default;
-		constexpr ~constant() = default;
+		flat_index(const flat_index&) = default;
+		flat_index& operator=(const flat_index&) = default;
+		flat_index(flat_index&&) = default;
+		flat_index& operator=(flat_index&&) = default;
+		~flat_index() = default;
 
-		constexpr auto operator<=>(const constant& c) const
+		std::size_t size() const noexcept
 		{
-			return this <=> &c;
+			return keys.size();
 		}
-
-		constexpr constant begin() const
+		void reserve(std::size_t n)
 		{
-			return *this;
+			keys.reserve(n);
+			grow(n);
+		}
+		void clear() noexcept
+		{
+			keys.clear();
+			slots.clear();
+		}
+		// Key with given id.
+		const K& key(std::size_t id) const
+		{
+			return keys[id];
+		}
+		// Keys in id order.
+		auto key_view() const noexcept
+		{
+			return counted(ptr<const K>(keys.data()), keys.size());
 		}
-		// no end()
 
-		constexpr operator bool() const
+		// Id of k or npos.
+		std::size_t find(const K& k) const
 		{
-			return true;
+			if (slots.empty()) {
+				return npos;
+			}
+			const std::uint64_t h = hash_of(k);
+			const std::size_t mask = slots.size() - 1;
+			for (std::size_t j = h & mask; slots[j]; j = (j + 1) & mask) {
+				const std::uint64_t s = slots[j];
+				if ((s & tag_mask) == (h & tag_mask) && eq(keys[(s & ~tag_mask) - 1], k)) {
+					return (s & ~tag_mask) - 1;
+				}
+			}
+
+			return npos;
 		}
-		constexpr value_type operator*() const
+		// Id of k and whether it was inserted.
+		std::pair<std::size_t, bool> insert(const K& k)
 		{
-			return t;
+			grow(keys.size() + 1);
+			const std::uint64_t h = hash_of(k);
+			const std::size_t mask = slots.size() - 1;
+			std::size_t j = h & mask;
+			for (; slots[j]; j = (j + 1) & mask) {
+				const std::uint64_t s = slots[j];
+				if ((s & tag_mask) == (h & tag_mask) && eq(keys[(s & ~tag_mask) - 1], k)) {
+					return { (s & ~tag_mask) - 1, false };
+				}
+			}
+			slots[j] = (h & tag_mask) | (keys.size() + 1);
+			keys.push_back(k);
+
+			return { keys.size() - 1, true };
 		}
-		constexpr constant& operator++()
+	};
+
+	// Aggregates have value_type, init(), operator()(acc, value), and merge(acc, acc).
+	namespace aggregate {
+
+		template<class T>
+		struct sum {
+			using value_type = T;
+			static constexpr T init() noexcept
+			{
+				return T(0);
+			}
+			constexpr T operator()(T a, T v) const
+			{
+				return a + v;
+			}
+			constexpr T merge(T a, T b) const
+			{
+				return a + b;
+			}
+		};
+
+		template<class T = std::size_t>
+		struct count {
+			using value_type = T;
+			static constexpr T init() noexcept
+			{
+				return T(0);
+			}
+			template<class V>
+			constexpr T operator()(T a, const V&) const
+			{
+				return a + 1;
+			}
+			constexpr T merge(T a, T b) const
+			{
+				return a + b;
+			}
+		};
+
+		template<class T>
+		struct min {
+			using value_type = T;
+			static constexpr T init() noexcept
+			{
+				return std::numeric_limits<T>::has_infinity ? std::numeric_limits<T>::infinity() : std::numeric_limits<T>::max();
+			}
+			constexpr T operator()(T a, T v) const
+			{
+				return v < a ? v : a;
+			}
+			constexpr T merge(T a, T b) const
+			{
+				return operator()(a, b);
+			}
+		};
+
+		template<class T>
+		struct max {
+			using value_type = T;
+			static constexpr T init() noexcept
+			{
+				return std::numeric_limits<T>::has_infinity ? -std::numeric_limits<T>::infinity() : std::numeric_limits<T>::lowest();
+			}
+			constexpr T operator()(T a, T v) const
+			{
+				return a < v ? v : a;
+			}
+			constexpr T merge(T a, T b) const
+			{
+				return operator()(a, b);
+			}
+		};
+
+	} // namespace aggregate
+
+	// Group by key on unsorted input. Aggregates for each key are stored in
+	// one array per aggregate indexed by the key id.
+	template<class K, class... As>
+	class hash_aggregate {
+		flat_index<K> index;
+		std::tuple<As...> as;
+		std::tuple<std::vector<typename As::value_type>...> vs;
+
+		template<std::size_t... N>
+		void push(std::index_sequence<N...>)
 		{
-			return *this;
+			(std::get<N>(vs).push_back(std::tuple_element_t<N, std::tuple<As...>>::init()), ...);
 		}
-		constexpr constant operator++(int)
+		template<class V, std::size_t... N>
+		void update(std::size_t id, const V& v, std::index_sequence<N...>)
 		{
-			return *this;
+			((std::get<N>(vs)[id] = std::get<N>(as)(std::get<N>(vs)[id], v)), ...);
 		}
-		// bidirectional
-		constexpr constant& operator--() noexcept
+		template<std::size_t... N>
+		void combine(std::size_t id, const hash_aggregate& h, std::size_t hid, std::index_sequence<N...>)
 		{
-			return *this;
+			((std::get<N>(vs)[id] = std::get<N>(as).merge(std::get<N>(vs)[id], std::get<N>(h.vs)[hid])), ...);
 		}
-		constexpr constant operator--(int) noexcept
+		std::size_t id(const K& k)
 		{
-			return *this;
+			const auto [id, inserted] = index.insert(k);
+			if (inserted) {
+				push(std::index_sequence_for<As...>{});
+			}
+
+			return id;
 		}
-		// random access
-		constexpr constant& operator+=(difference_type)
+	public:
+		hash_aggregate(As... as)
+			: as(std::move(as)...)
+		{ }
+		hash_aggregate(const hash_aggregate&) = default;
+		hash_aggregate& operator=(const hash_aggregate&) = default;
+		hash_aggregate(hash_aggregate&&) = default;
+		hash_aggregate& operator=(hash_aggregate&&) = default;
+		~hash_aggregate() = default;
+
+		// Number of distinct keys.
+		std::size_t size() const noexcept
 		{
-			return *this;
+			return index.size();
 		}
-		constexpr constant operator+(difference_type) const
+		void reserve(std::size_t n)
 		{
-			return *this;
+			index.reserve(n);
+			std::apply([n](auto&... v) { (v.reserve(n), ...); }, vs);
 		}
-		constexpr friend constant operator+(difference_type d, const constant& c)
+
+		// Update all aggregates for key k with value v.
+		template<class V>
+		hash_aggregate& add(const K& k, const V& v)
 		{
-			return c;
+			update(id(k), v, std::index_sequence_for<As...>{});
+
+			return *this;
 		}
-		constexpr constant& operator-=(difference_type)
+		// Consume iterable of (key, value) tuples.
+		template<class I>
+		hash_aggregate& add(I i)
 		{
+			while (i) {
+				const auto& kv = *i;
+				add(std::get<0>(kv), std::get<1>(kv));
+				++i;
+			}
+
 			return *this;
 		}
-		constexpr constant operator-(difference_type) const
+		// Combine partial aggregates from another table.
+		hash_aggregate& merge(const hash_aggregate& h)
 		{
+			for (std::size_t hid = 0; hid < h.size(); ++hid) {
+				combine(id(h.index.key(hid)), h, hid, std::index_sequence_for<As...>{});
+			}
+
 			return *this;
 		}
-		constexpr difference_type operator-(const constant&) const
+
+		// Distinct keys in order of first appearance.
+		auto keys() const noexcept
 		{
-			return 0;
+			return index.key_view();
 		}
-		constexpr value_type operator[](difference_type) const
+		// Values of the N-th aggregate in key order.
+		template<std::size_t N>
+		auto values() const noexcept
 		{
-			return t;
+			const auto& v = std::get<N>(vs);
+
+			return counted(ptr(v.data()), v.size());
 		}
-		constexpr reference operator[](difference_type)
+		// N-th aggregate for key k, if present.
+		template<std::size_t N>
+		auto find(const K& k) const
 		{
-			return t;
+			using T = std::tuple_element_t<N, std::tuple<typename As::value_type...>>;
+			const auto id = index.find(k);
+
+			return id == index.npos ? std::optional<T>{} : std::optional<T>(std::get<N>(vs)[id]);
 		}
 	};
 
-	template<class T>
-	constexpr auto single(T t)
+	// Aggregate iterable of (key, value) tuples by key.
+	template<class I, class... As,
+		class K = std::remove_cvref_t<std::tuple_element_t<0, std::iter_value_t<I>>>>
+	inline auto hash_group(I i, As... as)
 	{
-		return take(constant<T>(t), 1);
+		hash_aggregate<K, As...> h(as...);
+		h.add(i);
+
+		return h;
 	}
 
-	// i0 then i1
-	template <class I0, class I1, class T = std::common_type_t<typename I0::value_type, typename I1::value_type>>
-	class concatenate2 {
-		I0 i0;
-		I1 i1;
+	// Partition i over threads, aggregate each part, then merge.
+	// Random access i is partitioned in constant time.
+	template<class I, class... As,
+		class K = std::remove_cvref_t<std::tuple_element_t<0, std::iter_value_t<I>>>>
+	inline auto par_hash_group(I i, std::size_t threads, As... as)
+		requires has_end<I>
+	{
+		const auto n = static_cast<std::size_t>(size(i));
+		threads = std::max<std::size_t>(1, std::min(threads, n));
+		const auto m = (n + threads - 1) / threads;
+
+		std::vector<hash_aggregate<K, As...>> hs(threads, hash_aggregate<K, As...>(as...));
+		std::vector<std::thread> ts;
+		for (std::size_t t = 1; t < threads; ++t) {
+			ts.emplace_back([&hs, i, m, t]() {
+				FMS_ITERABLE_SPAN("par_hash_group", "chunk");
+				hs[t].add(take(drop(i, t * m), m));
+			});
+		}
+		{
+			FMS_ITERABLE_SPAN("par_hash_group", "chunk");
+			hs[0].add(take(i, m));
+		}
+		for (auto& t : ts) {
+			t.join();
+		}
+		for (std::size_t t = 1; t < threads; ++t) {
+			hs[0].merge(hs[t]);
+		}
+
+		return hs[0];
+	}
+
+	// Equi-join of a finite build side with a streamed probe side.
+	// Yields tuple(build value, probe value) for each match in probe order.
+	// Build rows are split by hash into partitions that fit in L2 cache,
+	// each holding a flat_index and its rows grouped by key.
+	template<class B, class P, class KB, class KP>
+	class hash_join {
+		using V = std::iter_value_t<B>;
+		using U = std::iter_value_t<P>;
+		using K = std::remove_cvref_t<std::invoke_result_t<KB, const V&>>;
+
+		static constexpr std::size_t l2_bytes = std::size_t(1) << 18;
+
+		struct partition {
+			flat_index<K> index;
+			std::vector<std::size_t> offset; // rows of id are [offset[id], offset[id + 1])
+			std::vector<V> rows;
+		};
+		struct table {
+			unsigned bits; // partition is top bits of hash
+			std::vector<partition> parts;
+
+			std::size_t part(const K& k) const
+			{
+				return bits ? hash_mix(std::hash<K>{}(k)) >> (64 - bits) : 0;
+			}
+		};
+
+		std::shared_ptr<const table> t; // shared by copies
+		copy_assignable<KP> kp;
+		P p;
+		const V* r; // current match
+		const V* re; // end of matches
+
+		static std::shared_ptr<const table> build(B b, const KB& kb, std::size_t partitions)
+		{
+			std::vector<V> vs;
+			while (b) {
+				vs.push_back(*b);
+				++b;
+			}
+
+			auto t = std::make_shared<table>();
+			if (partitions == 0) {
+				partitions = (vs.size() * (sizeof(V) + sizeof(K) + 4 * sizeof(std::uint64_t))) / l2_bytes + 1;
+			}
+			t->bits = 0;
+			while ((std::size_t(1) << t->bits) < partitions) {
+				++t->bits;
+			}
+			t->parts.resize(std::size_t(1) << t->bits);
+
+			// radix scatter rows into partitions
+			std::vector<std::vector<V>> ps(t->parts.size());
+			if (t->bits) {
+				for (auto& v : vs) {
+					ps[t->part(kb(v))].push_back(std::move(v));
+				}
+			}
+			else {
+				ps[0] = std::move(vs);
+			}
+
+			for (std::size_t j = 0; j < ps.size(); ++j) {
+				auto& pj = t->parts[j];
+				std::vector<std::size_t> ids(ps[j].size());
+				for (std::size_t k = 0; k < ps[j].size(); ++k) {
+					ids[k] = pj.index.insert(kb(ps[j][k])).first;
+				}
+				pj.offset.assign(pj.index.size() + 1, 0);
+				for (auto id : ids) {
+					++pj.offset[id + 1];
+				}
+				for (std::size_t id = 0; id < pj.index.size(); ++id) {
+					pj.offset[id + 1] += pj.offset[id];
+				}
+				std::vector<std::size_t> next(pj.offset.begin(), pj.offset.end() - 1);
+				std::vector<std::optional<V>> rows(ps[j].size());
+				for (std::size_t k = 0; k < ps[j].size(); ++k) {
+					rows[next[ids[k]]++].emplace(std::move(ps[j][k]));
+				}
+				pj.rows.reserve(rows.size());
+				for (auto& v : rows) {
+					pj.rows.push_back(std::move(*v));
+				}
+			}
+
+			return t;
+		}
+		void seek()
+		{
+			while (p) {
+				const auto k = kp(*p);
+				const auto& pj = t->parts[t->part(k)];
+				const auto id = pj.index.find(k);
+				if (id != pj.index.npos) {
+					r = pj.rows.data() + pj.offset[id];
+					re = pj.rows.data() + pj.offset[id + 1];
+
+					return;
+				}
+				++p;
+			}
+			r = re = nullptr;
+		}
 	public:
 		using iterator_category = std::input_iterator_tag;
-		using value_type = T;
-		using reference = T&;
-		using pointer = T*;
-		using difference_type = std::common_type_t<typename I0::difference_type, typename I1::difference_type>;
+		using value_type = std::tuple<V, U>;
+		using reference = value_type&;
+		using pointer = value_type*;
+		using difference_type = std::ptrdiff_t;
 
-		constexpr concatenate2() = default;
-		constexpr concatenate2(const I0& i0, const I1& i1)
-			: i0(i0), i1(i1)
-		{ }
-		constexpr concatenate2(const concatenate2&) = default;
-		constexpr concatenate2& operator=(const concatenate2&) = default;
-		constexpr concatenate2(concatenate2&&) = default;
-		constexpr concatenate2& operator=(concatenate2&&) = default;
-		constexpr ~concatenate2() = default;
+		// Use partitions = 0 to pick the number of partitions from the build size.
+		hash_join(B b, P p, KB kb, KP kp, std::size_t partitions = 0)
+			: t(build(b, kb, partitions)), kp(std::move(kp)), p(std::move(p)), r(nullptr), re(nullptr)
+		{
+			seek();
+		}
+		hash_join(const hash_join&) = default;
+		hash_join& operator=(const hash_join&) = default;
+		hash_join(hash_join&&) = default;
+		hash_join& operator=(hash_join&&) = default;
+		~hash_join() = default;
 
-		constexpr bool operator==(const concatenate2& i) const = default;
+		bool operator==(const hash_join& j) const
+		{
+			return p == j.p && r == j.r;
+		}
 
-		constexpr auto begin() const
+		hash_join begin() const
 		{
 			return *this;
 		}
-		constexpr auto end() const
+		hash_join end() const
+			requires has_end<P>
 		{
-			return concatenate2(i0.end(), i1.end());
+			auto j{ *this };
+			j.p = p.end();
+			j.r = j.re = nullptr;
+
+			return j;
 		}
 
-		constexpr explicit operator bool() const
+		// Number of partitions of the build side.
+		std::size_t partitions() const noexcept
 		{
-			return i0 || i1;
+			return t->parts.size();
 		}
-		constexpr value_type operator*() const
+
+		explicit operator bool() const noexcept
 		{
-			return i0 ? *i0 : *i1;
+			return r != re;
 		}
-		constexpr concatenate2& operator++()
+		value_type operator*() const
 		{
-			if (i0) {
-				++i0;
-			}
-			else {
-				++i1;
+			return value_type(*r, *p);
+		}
+		hash_join& operator++()
+		{
+			if (r != re && ++r == re) {
+				++p;
+				seek();
 			}
 
 			return *this;
 		}
-		constexpr concatenate2 operator++(int) noexcept
+		hash_join operator++(int)
 		{
 			auto tmp{ *this };
 
@@ -987,120 +3661,135 @@ namespace fms::iterable {
 			return tmp;
 		}
 	};
-	template<class I>
-	constexpr auto concatenate(I i)
-	{
-		return i;
-	}
-	template<class I, class ...Is>
-	constexpr auto concatenate(I i, Is... is)
-	{
-		return concatenate2(i, concatenate(is...));
-	}
 
-	// Sorted i0 and i1 in order. Equivalent (!< and !>) elements are repeated.
-	template <class I0, class I1, class T = std::common_type_t<typename I0::value_type, typename I1::value_type>>
-	class merge2 {
-		I0 i0;
-		I1 i1;
-		bool _0; // true use i0, false use i1
+	// First occurrence of each value.
+	// If w > 0 then memory is bounded by keeping two generations of at most w
+	// values, so at least the last w distinct values are remembered.
+	// Copies share append only generations and each sees its own prefix, so
+	// copying is cheap and copies traverse independently.
+	template<class I, class T = std::iter_value_t<I>>
+	class distinct {
+		// Ids [0, n) of a generation shared by copies.
+		struct view {
+			std::shared_ptr<flat_index<T>> g;
+			std::size_t n;
+
+			bool contains(const T& t) const
+			{
+				return g->find(t) < n;
+			}
+			void add(const T& t)
+			{
+				if (g->size() != n) {
+					if (g->find(t) == n) {
+						++n; // a copy ahead added the same value
+
+						return;
+					}
+					// diverged from the copy ahead
+					auto h = std::make_shared<flat_index<T>>();
+					h->reserve(n);
+					for (std::size_t id = 0; id < n; ++id) {
+						h->insert(g->key(id));
+					}
+					g = std::move(h);
+				}
+				g->insert(t);
+				++n;
+			}
+		};
+		struct seen_t {
+			view cur, old;
+			std::size_t w;
+
+			void add(const T& t)
+			{
+				if (w && cur.n == w) {
+					old = std::move(cur);
+					cur = view{ std::make_shared<flat_index<T>>(), 0 };
+				}
+				cur.add(t);
+			}
+			// True if t was not seen.
+			bool insert(const T& t)
+			{
+				if (cur.contains(t)) {
+					return false;
+				}
+				if (w && old.n && old.contains(t)) {
+					add(t); // keep recently seen values
+
+					return false;
+				}
+				add(t);
+
+				return true;
+			}
+		};
+
+		seen_t seen;
+		I i;
+
+		void next()
+		{
+			while (i && !seen.insert(*i)) {
+				++i;
+			}
+		}
 	public:
 		using iterator_category = std::input_iterator_tag;
 		using value_type = T;
 		using reference = T&;
 		using pointer = T*;
-		using difference_type = std::common_type_t<typename I0::difference_type, typename I0::difference_type>;
+		using difference_type = std::ptrdiff_t;
 
-		constexpr merge2() = default;
-		constexpr merge2(const I0& i0, const I1& i1)
-			: i0(i0), i1(i1)
+		distinct(I i, std::size_t w = 0)
+			: seen{ { std::make_shared<flat_index<T>>(), 0 }, { nullptr, 0 }, w }, i(std::move(i))
 		{
-			if (i0 && i1) {
-				if (*i1 < *i0) {
-					_0 = false;
-				}
-				else { // less or equivalent
-					_0 = true;
-				}
-			}
-			else if (i0) {
-				_0 = true;
-			}
-			else {
-				_0 = false;
-			}
+			next();
 		}
-		constexpr merge2(const merge2&) = default;
-		constexpr merge2& operator=(const merge2&) = default;
-		constexpr merge2(merge2&&) = default;
-		constexpr merge2& operator=(merge2&&) = default;
-		constexpr ~merge2() = default;
+		distinct(const distinct&) = default;
+		distinct& operator=(const distinct&) = default;
+		distinct(distinct&&) = default;
+		distinct& operator=(distinct&&) = default;
+		~distinct() = default;
 
-		constexpr bool operator==(const merge2& i) const = default;
+		bool operator==(const distinct& d) const
+		{
+			return i == d.i;
+		}
 
-		constexpr auto begin() const
+		distinct begin() const
 		{
 			return *this;
 		}
-		constexpr auto end() const
+		distinct end() const
+			requires has_end<I>
 		{
-			return merge2(i0.end(), i1.end());
+			auto d{ *this };
+			d.i = i.end();
+
+			return d;
 		}
 
-		constexpr explicit operator bool() const
+		explicit operator bool() const noexcept
 		{
-			return i0 || i1;
+			return !!i;
 		}
-		constexpr value_type operator*() const
+		value_type operator*() const
 		{
-			if (i0 && i1) {
-				if (*i0 < *i1) {
-					return *i0;
-				}
-				else if (*i1 < *i0) {
-					return *i1;
-				}
-				else {
-					return _0 ? *i0 : *i1;
-				}
-			}
-
-			return i0 ? *i0 : *i1;
+			return *i;
 		}
-		constexpr merge2& operator++()
+		distinct& operator++()
 		{
-			if (i0 && i1) {
-				if (*i0 < *i1) {
-					++i0;
-				}
-				else if (*i1 < *i0) {
-					++i1;
-				}
-				else { // equivalent
-					if (_0) {
-						++i0;
-					}
-					else {
-						++i1;
-					}
-					_0 = !_0; // switch
-				}
-			}
-			else {
-				if (i0) {
-					++i0;
-					_0 = true;
-				}
-				else if (i1) {
-					++i1;
-					_0 = false;
-				}
+			if (i) {
+				++i;
+				next();
 			}
 
-
 			return *this;
 		}
-		constexpr merge2 operator++(int) noexcept
+		distinct operator++(int)
 		{
 			auto tmp{ *this };
 
@@ -1109,101 +3798,222 @@ namespace fms::iterable {
 			return tmp;
 		}
 	};
-	template<class I>
-	constexpr auto merge(I i)
-	{
-		return i;
-	}
-	template<class I, class ...Is>
-	constexpr auto merge(I i, Is... is)
-	{
-		return merge2(i, merge(is...));
-	}
 
-	// copy assignable function object
-	template<class F>
-	class copy_assignable {
-		std::optional<F> f;
+	// Split block Bloom filter. Each key sets one bit in each of the 8 words
+	// of a single 32 byte block, so a probe touches one cache line.
+	template<class K, class Hash = std::hash<K>>
+	class bloom {
+		struct alignas(32) block {
+			std::uint32_t w[8];
+		};
+		static constexpr std::uint32_t salt[8] = {
+			0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+			0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U
+		};
+
+		std::vector<block> bs;
+		[[no_unique_address]] Hash hash;
+
+		std::uint64_t hash_of(const K& k) const
+		{
+			return hash_mix(static_cast<std::uint64_t>(hash(k)));
+		}
+		// Block from high bits, bits within block from low bits.
+		std::size_t index(std::uint64_t h) const noexcept
+		{
+			return static_cast<std::size_t>(((h >> 32) * bs.size()) >> 32);
+		}
+		static bool test(const block& b, std::uint32_t h) noexcept
+		{
+#ifdef FMS_ITERABLE_AVX2
+			const __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(salt));
+			const __m256i x = _mm256_srli_epi32(_mm256_mullo_epi32(_mm256_set1_epi32(static_cast<int>(h)), s), 27);
+			const __m256i m = _mm256_sllv_epi32(_mm256_set1_epi32(1), x);
+
+			return _mm256_testc_si256(_mm256_load_si256(reinterpret_cast<const __m256i*>(b.w)), m);
+#else
+			bool in = true;
+			for (int j = 0; j < 8; ++j) {
+				in &= ((b.w[j] >> ((h * salt[j]) >> 27)) & 1) != 0;
+			}
+
+			return in;
+#endif
+		}
 	public:
-		constexpr copy_assignable() noexcept = default;
-		constexpr copy_assignable(F f) noexcept
-			: f(std::move(f))
-		{ }
-		copy_assignable(const copy_assignable& a)
+		using key_type = K;
+
+		// Sized for n keys with false positive rate about p in (0, 1).
+		bloom(std::size_t n, double p = 0.01, Hash hash = Hash{})
+			: hash(std::move(hash))
 		{
-			f.reset();
-			if (a.f.has_value()) {
-				f.emplace(a.f.value());
+			if (!(p > 0 && p < 1)) {
+				throw std::invalid_argument("bloom: false positive rate must be in (0, 1)");
 			}
+			const double m = -static_cast<double>(n) * std::log(p) / (std::log(2.) * std::log(2.));
+			bs.resize(std::max<std::size_t>(1, static_cast<std::size_t>(m / 256) + 1), block{});
 		}
-		copy_assignable& operator=(const copy_assignable& a)
+		// Build from keys of i.
+		template<class I>
+			requires has_end<I>
+		bloom(I i, double p = 0.01, Hash hash = Hash{})
+			: bloom(static_cast<std::size_t>(size(i)), p, std::move(hash))
 		{
-			if (this != &a) {
-				f.reset();
-				if (a.f.has_value()) {
-					f.emplace(a.f.value());
-				}
+			add(i);
+		}
+		bloom(const bloom&) = default;
+		bloom& operator=(const bloom&) = default;
+		bloom(bloom&&) = default;
+		bloom& operator=(bloom&&) = default;
+		~bloom() = default;
+
+		// Size of filter in bytes.
+		std::size_t bytes() const noexcept
+		{
+			return bs.size() * sizeof(block);
+		}
+
+		void insert(const K& k)
+		{
+			const auto h = hash_of(k);
+			auto& b = bs[index(h)];
+			for (int j = 0; j < 8; ++j) {
+				b.w[j] |= std::uint32_t(1) << ((static_cast<std::uint32_t>(h) * salt[j]) >> 27);
+			}
+		}
+		// Insert all keys of i.
+		template<class I>
+		bloom& add(I i)
+		{
+			while (i) {
+				insert(*i);
+				++i;
 			}
 
 			return *this;
 		}
-		copy_assignable(copy_assignable&&) = default;
-		copy_assignable& operator=(copy_assignable&&) = default;
-		~copy_assignable() = default;
 
-		template<class... Args>
-		constexpr auto operator()(Args&&... args) const
+		// False means k was never inserted.
+		bool contains(const K& k) const
 		{
-			return f.has_value() ? f.value()(std::forward<Args>(args)...) : decltype(f.value()(std::forward<Args>(args)...)){};
+			const auto h = hash_of(k);
+
+			return test(bs[index(h)], static_cast<std::uint32_t>(h));
+		}
+		// Predicate for use with filter.
+		bool operator()(const K& k) const
+		{
+			return contains(k);
+		}
+		// Probe n contiguous keys, hashing a batch before touching any block.
+		void contains(const K* k, std::size_t n, bool* in) const
+		{
+			constexpr std::size_t B = 16;
+			std::uint64_t h[B];
+			while (n) {
+				const std::size_t m = std::min(n, B);
+				for (std::size_t j = 0; j < m; ++j) {
+					h[j] = hash_of(k[j]);
+				}
+				for (std::size_t j = 0; j < m; ++j) {
+					in[j] = test(bs[index(h[j])], static_cast<std::uint32_t>(h[j]));
+				}
+				k += m;
+				in += m;
+				n -= m;
+			}
 		}
 	};
+	template<class I>
+		requires has_end<I>
+	bloom(I) -> bloom<std::iter_value_t<I>>;
+	template<class I>
+		requires has_end<I>
+	bloom(I, double) -> bloom<std::iter_value_t<I>>;
 
-	// Apply a function to elements of an iterable.
-	template <class F, class I>
-	class apply {
-		using T = std::iter_value_t<I>;
-		using U = std::invoke_result_t<F, T>;
+	// Chunks of at most g elements of i handed out by an atomic cursor.
+	// Copies share the cursor so threads can balance load dynamically.
+	// A chunk is claimed by begin() or on first use, so copy before using
+	// to give each thread its own position. Comparison never claims.
+	template<class I>
+		requires has_end<I> && std::random_access_iterator<I>
+	class shared_cursor {
+		static constexpr std::size_t unclaimed = static_cast<std::size_t>(-1);
 
-		copy_assignable<F> f; // for operator=(const apply&)
+		std::shared_ptr<std::atomic<std::size_t>> next;
 		I i;
+		std::size_t n, g;
+		mutable std::size_t k; // start of current chunk
+
+		void claim() const
+		{
+			if (k == unclaimed) {
+				k = std::min(n, next->fetch_add(g, std::memory_order_relaxed));
+			}
+		}
 	public:
 		using iterator_category = std::input_iterator_tag;
-		using value_type = U;
-		using reference = U&;
-		using pointer = U*;
-		using difference_type = typename I::difference_type;
+		using value_type = counted<I>;
+		using reference = value_type&;
+		using pointer = value_type*;
+		using difference_type = std::ptrdiff_t;
 
-		constexpr apply() = default;
-		constexpr apply(F f, const I& i)
-			: f(std::move(f)), i(i)
+		shared_cursor(I i, std::size_t g)
+			: next(std::make_shared<std::atomic<std::size_t>>(0)),
+			  i(std::move(i)), n(static_cast<std::size_t>(size(this->i))), g(g ? g : 1), k(unclaimed)
 		{ }
-		constexpr apply(const apply& a) = default;
-		constexpr apply& operator=(const apply& a) = default;
-		constexpr apply(apply&& a) = default;
-		constexpr apply& operator=(apply&& a) = default;
-		constexpr ~apply() = default;
+		shared_cursor(const shared_cursor&) = default;
+		shared_cursor& operator=(const shared_cursor&) = default;
+		shared_cursor(shared_cursor&&) = default;
+		shared_cursor& operator=(shared_cursor&&) = default;
+		~shared_cursor() = default;
 
-		constexpr bool operator==(const apply& a) const
+		// An unclaimed cursor is only equal to an unclaimed cursor.
+		bool operator==(const shared_cursor& c) const
 		{
-			return i == a.i; // F is part of type
+			return next == c.next && k == c.k;
 		}
 
-		constexpr explicit operator bool() const
+		shared_cursor begin() const
 		{
-			return i.operator bool();
+			auto c{ *this };
+			c.claim();
+
+			return c;
 		}
-		constexpr value_type operator*() const
+		shared_cursor end() const
 		{
-			return f(*i);
+			auto c{ *this };
+			c.k = n;
+
+			return c;
 		}
-		constexpr apply& operator++() noexcept
+
+		explicit operator bool() const
 		{
-			++i;
+			claim();
+
+			return k < n;
+		}
+		value_type operator*() const
+		{
+			claim();
+
+			return counted(std::next(i, k), std::min(g, n - k));
+		}
+		shared_cursor& operator++()
+		{
+			claim();
+			if (k < n) {
+				k = unclaimed;
+				claim();
+			}
 
 			return *this;
 		}
-		constexpr apply operator++(int) noexcept
+		shared_cursor operator++(int)
 		{
+			claim();
 			auto tmp{ *this };
 
 			operator++();
@@ -1212,116 +4022,188 @@ namespace fms::iterable {
 		}
 	};
 
-	// Apply a binary operation to elements of two iterable.
-	template <class BinOp, class I0, class I1>
-	class binop {
-		using T0 = std::iter_value_t<I0>;
-		using T1 = std::iter_value_t<I1>;
-		using T = std::invoke_result_t<BinOp, T0, T1>;
-		
-		copy_assignable<BinOp> op;
-		I0 i0;
-		I1 i1;
-		public:
-			using iterator_category = std::input_iterator_tag;
-			using value_type = T;
-			using reference = T&;
-			using difference_type = std::ptrdiff_t;
-
-			constexpr binop(BinOp op, I0 i0, I1 i1)
-				: op(std::move(op)), i0(i0), i1(i1)
-			{ }
-			constexpr binop(const binop& o) = default;
-			constexpr binop& operator=(const binop& o) = default;
-			constexpr binop(binop&& o) noexcept = default;
-			constexpr binop& operator=(binop&& o) = default;
-			constexpr ~binop() = default;
-
-			constexpr bool operator==(const binop& o) const
-			{
-				return i0 == o.i0 && i1 == o.i1;
-			}
+	// Apply f on threads to at most window elements ahead of the consumer
+	// and yield the results in source order. Workers pull from i under a
+	// lock so i can be input only. f must be safe to call concurrently.
+	// Exceptions thrown by f or i are rethrown in source order. An exception
+	// from i ends the sequence, dropping an element read before it.
+	// Copies share the workers, so par_apply is single pass.
+	template<class F, class I>
+	class par_apply {
+		using T = std::iter_value_t<I>;
+		using U = std::invoke_result_t<F, T>;
 
-			constexpr explicit operator bool() const
+		struct state {
+			F f;
+			I i;
+			std::size_t window;
+			std::mutex m;
+			std::condition_variable cv;
+			std::vector<std::optional<U>> slot; // result k is in slot[k % window]
+			std::vector<std::exception_ptr> error;
+			std::size_t in, out; // next to pull, next to yield
+			bool done, stop; // i exhausted, shutting down
+			std::vector<std::thread> ts;
+
+			state(F f, I i, std::size_t threads, std::size_t window)
+				: f(std::move(f)), i(std::move(i)), window(window), slot(window), error(window),
+				  in(0), out(0), done(false), stop(false)
 			{
-				return i0 && i1;
+				for (std::size_t t = 0; t < threads; ++t) {
+					ts.emplace_back([this]() { work(); });
+				}
 			}
-			constexpr value_type operator*() const
+			state(const state&) = delete;
+			state& operator=(const state&) = delete;
+			~state()
 			{
-				return op(*i0, *i1);
+				{
+					std::lock_guard l(m);
+					stop = true;
+				}
+				cv.notify_all();
+				for (auto& t : ts) {
+					t.join();
+				}
 			}
-			constexpr binop& operator++() noexcept
-			{
-				++i0;
-				++i1;
 
-				return *this;
-			}
-			constexpr binop operator++(int) noexcept
+			void work()
 			{
-				auto b{ *this };
+				std::unique_lock l(m);
+				for (;;) {
+					cv.wait(l, [this]() { return stop || (!done && in - out < window); });
+					if (stop) {
+						return;
+					}
+					std::optional<T> t;
+					std::exception_ptr e;
+					try {
+						if (i) {
+							t.emplace(*i);
+							++i;
+						}
+					}
+					catch (...) {
+						e = std::current_exception();
+					}
+					if (!t && !e) {
+						done = true;
+						cv.notify_all();
 
-				operator++();
+						continue;
+					}
+					const auto k = in++ % window;
+					if (e) {
+						done = true; // i is in an unknown state
+						error[k] = e;
+						cv.notify_all();
 
-				return b;
-			}
-	};
+						continue;
+					}
+					l.unlock();
 
+					std::optional<U> u;
+					try {
+						FMS_ITERABLE_SPAN("par_apply", "task");
+						u.emplace(f(std::move(*t)));
+					}
+					catch (...) {
+						e = std::current_exception();
+					}
 
-	// Elements satisfying predicate.
-	template <class P, class I>
-	class filter {
-		using T = std::iter_value_t<I>;
+					l.lock();
+					slot[k] = std::move(u);
+					error[k] = e;
+					cv.notify_all();
+				}
+			}
+			// Next result in source order, empty if exhausted.
+			std::optional<U> pop()
+			{
+				std::unique_lock l(m);
+				const auto k = out % window;
+				const auto ready = [this, k]() { return slot[k] || error[k] || (done && in == out); };
+				if (!ready()) {
+					FMS_ITERABLE_SPAN("par_apply", "wait");
+					cv.wait(l, ready);
+				}
+				if (!slot[k] && !error[k]) {
+					return std::nullopt;
+				}
+				std::optional<U> u = std::move(slot[k]);
+				std::exception_ptr e = error[k];
+				slot[k].reset();
+				error[k] = nullptr;
+				++out;
+				l.unlock();
+				cv.notify_all();
+				if (e) {
+					std::rethrow_exception(e);
+				}
 
-		copy_assignable<P> p;
-		I i;
+				return u;
+			}
+		};
+
+		std::shared_ptr<state> s;
+		std::optional<U> u; // current result
+		std::size_t pos; // index of current result
+	public:
+		using iterator_category = std::input_iterator_tag;
+		using value_type = U;
+		using reference = U&;
+		using pointer = U*;
+		using difference_type = std::ptrdiff_t;
 
-		constexpr void next()
+		// Use window = 0 for twice the number of threads.
+		par_apply(F f, I i, std::size_t threads = std::thread::hardware_concurrency(), std::size_t window = 0)
+			: pos(0)
 		{
-			while (i && !p(*i)) {
-				++i;
-			}
+			threads = std::max<std::size_t>(1, threads);
+			s = std::make_shared<state>(std::move(f), std::move(i), threads, window ? window : 2 * threads);
+			u = s->pop();
 		}
-	public:
-		using iterator_category = std::input_iterator_tag;
-		using value_type = T;
-		using reference = T&;
-		using pointer = T*;
-		using difference_type = typename I::difference_type;
+		par_apply(const par_apply&) = default;
+		par_apply& operator=(const par_apply&) = default;
+		par_apply(par_apply&&) = default;
+		par_apply& operator=(par_apply&&) = default;
+		~par_apply() = default;
 
-		constexpr filter() = default;
-		constexpr filter(P p, const I& i)
-			: p(std::move(p)), i(i)
+		bool operator==(const par_apply& a) const
 		{
-			next();
+			return s == a.s && (u ? pos : 0) == (a.u ? a.pos : 0) && !u == !a.u;
 		}
-		constexpr filter(const filter& a) = default;
-		constexpr filter& operator=(const filter& a) = default;
-		constexpr filter(filter&& a) = default;
-		constexpr filter& operator=(filter&& a) = default;
-		constexpr ~filter() = default;
 
-		constexpr bool operator==(const filter& a) const
+		par_apply begin() const
 		{
-			return i == a.i; // P is part of type
+			return *this;
 		}
+		par_apply end() const
+		{
+			auto a{ *this };
+			a.u.reset();
 
-		constexpr explicit operator bool() const
+			return a;
+		}
+
+		explicit operator bool() const noexcept
 		{
-			return i.operator bool();
+			return u.has_value();
 		}
-		constexpr value_type operator*() const
+		value_type operator*() const
 		{
-			return *i;
+			return *u;
 		}
-		constexpr filter& operator++() noexcept
+		par_apply& operator++()
 		{
-			++i;
-			next();
+			if (u) {
+				u = s->pop();
+				++pos;
+			}
 
 			return *this;
 		}
-		constexpr filter operator++(int) noexcept
+		par_apply operator++(int)
 		{
 			auto tmp{ *this };
 
@@ -1331,48 +4213,76 @@ namespace fms::iterable {
 		}
 	};
 
-	// Stop at first element satisfying predicate.
-	template <class P, class I, class T = typename I::value_type>
-	class until {
-		copy_assignable<P> p;
+	// Stop when the time budget is exhausted. The clock is read only every
+	// n elements, so iteration may run over budget by n - 1 elements.
+	// Clock needs now(), time_point, and duration like the std clocks,
+	// e.g. one reading the TSC.
+	// Iterate directly or use for_each_until(d, s) to call truncated() after.
+	template<class I, class Clock = std::chrono::steady_clock>
+	class deadline {
 		I i;
+		typename Clock::time_point t; // expiry
+		std::size_t n, k; // clock read when k reaches n
+		bool expired;
+
+		void tick()
+		{
+			if (++k == n) {
+				k = 0;
+				expired = Clock::now() >= t;
+			}
+		}
 	public:
 		using iterator_category = std::input_iterator_tag;
-		using value_type = T;
-		using reference = T&;
-		using pointer = T*;
+		using value_type = typename I::value_type;
+		using reference = typename I::reference;
+		using pointer = typename I::pointer;
 		using difference_type = typename I::difference_type;
 
-		constexpr until() = default;
-		constexpr until(P p, const I& i)
-			: p(std::move(p)), i(i)
+		deadline(I i, typename Clock::duration budget, std::size_t n = 64)
+			: i(std::move(i)), t(Clock::now() + budget), n(n ? n : 1), k(0), expired(budget <= budget.zero())
 		{ }
-		constexpr until(const until&) = default;
-		constexpr until& operator=(const until&) = default;
-		constexpr until(until&&) = default;
-		constexpr until& operator=(until&&) = default;
-		constexpr ~until() = default;
+		deadline(const deadline&) = default;
+		deadline& operator=(const deadline&) = default;
+		deadline(deadline&&) = default;
+		deadline& operator=(deadline&&) = default;
+		~deadline() = default;
 
-		constexpr bool operator==(const until& u) const
+		bool operator==(const deadline& d) const
 		{
-			return i == u.i;
+			return i == d.i && expired == d.expired;
 		}
 
-		constexpr explicit operator bool() const
+		deadline begin() const
 		{
-			return i && !p(*i);
+			return *this;
 		}
-		constexpr value_type operator*() const
+		// no end()
+
+		// Stopped by the deadline before i was exhausted.
+		bool truncated() const
+		{
+			return expired && valid(i);
+		}
+
+		explicit operator bool() const
+		{
+			return !expired && valid(i);
+		}
+		value_type operator*() const
 		{
 			return *i;
 		}
-		constexpr until& operator++() noexcept
+		deadline& operator++()
 		{
-			++i;
+			if (!expired) {
+				++i;
+				tick();
+			}
 
 			return *this;
 		}
-		constexpr until operator++(int) noexcept
+		deadline operator++(int)
 		{
 			auto tmp{ *this };
 
@@ -1380,54 +4290,99 @@ namespace fms::iterable {
 
 			return tmp;
 		}
+		template<class S>
+		bool for_each_until(S&& s)
+		{
+			bool go = true;
+			while (go && !expired && valid(i)) {
+				go = s(*i);
+				++i;
+				tick();
+			}
+
+			return go;
+		}
 	};
 
-	// Right fold: of op
-	template <class BinOp, class I, class T = typename I::value_type>
-	class fold {
-		copy_assignable<BinOp> op;
+	// Record the state of i every k elements on first traversal so drop(n)
+	// replays at most k - 1 elements from the nearest checkpoint.
+	// Copies share checkpoints and are not thread safe.
+	template<class I>
+	class indexed {
+		struct index {
+			std::size_t k;
+			std::vector<I> cp; // cp[j] is i after j * k increments
+		};
+
 		I i;
-		T t;
+		std::shared_ptr<index> x;
+		std::size_t pos; // increments since construction
+
+		void step()
+		{
+			++i;
+			++pos;
+			if (pos == x->cp.size() * x->k && valid(i)) {
+				x->cp.push_back(i);
+			}
+		}
 	public:
 		using iterator_category = std::input_iterator_tag;
-		using value_type = T;
-		using reference = T&;
-		using pointer = T*;
-		using difference_type = std::ptrdiff_t;
+		using value_type = typename I::value_type;
+		using reference = typename I::reference;
+		using pointer = typename I::pointer;
+		using difference_type = typename I::difference_type;
 
-		constexpr fold() = default;
-		constexpr fold(BinOp op, const I& i, T t = 0)
-			: op(std::move(op)), i(i), t(t)
-		{ }
-		constexpr fold(const fold& f) = default;
-		constexpr fold& operator=(const fold& f) = default;
-		constexpr fold(fold&& f) = default;
-		constexpr fold& operator=(fold&& f) noexcept = default;
-		constexpr ~fold() = default;
+		indexed(I i, std::size_t k = 1024)
+			: i(std::move(i)), x(std::make_shared<index>(index{ k ? k : 1, {} })), pos(0)
+		{
+			x->cp.push_back(this->i);
+		}
+		indexed(const indexed&) = default;
+		indexed& operator=(const indexed&) = default;
+		indexed(indexed&&) = default;
+		indexed& operator=(indexed&&) = default;
+		~indexed() = default;
 
-		constexpr bool operator==(const fold& f) const
+		bool operator==(const indexed& j) const
 		{
-			return i == f.i && t == f.t;
+			return x == j.x && pos == j.pos;
 		}
 
-		constexpr explicit operator bool() const
+		// Position from the start of the original iterable.
+		std::size_t position() const
 		{
-			return i.operator bool();
+			return pos;
 		}
-		constexpr value_type operator*() const noexcept
+		// Number of checkpoints recorded.
+		std::size_t checkpoints() const
 		{
-			return t;
+			return x->cp.size();
 		}
-		constexpr fold& operator++() noexcept
+
+		indexed begin() const
 		{
-			if (i) {
-				t = op(t, *i);
-				++i;
+			return *this;
+		}
+		// no end()
+
+		explicit operator bool() const
+		{
+			return valid(i);
+		}
+		value_type operator*() const
+		{
+			return *i;
+		}
+		indexed& operator++()
+		{
+			if (valid(i)) {
+				step();
 			}
 
 			return *this;
 		}
-		constexpr fold operator++(int) noexcept
+		indexed operator++(int)
 		{
 			auto tmp{ *this };
 
@@ -1435,82 +4390,94 @@ namespace fms::iterable {
 
 			return tmp;
 		}
-	};
-
-	template <class I, class T = typename I::value_type>
-	inline auto sum(I i, T t = 0)
-	{
-		while (i) {
-			t += *i;
-			++i;
-		}
 
-		return t;
-	}
+		// Advance at most n elements from the nearest checkpoint.
+		indexed drop(difference_type n) const
+		{
+			auto j{ *this };
+			if (n <= 0) {
+				return j;
+			}
+			const std::size_t to = pos + static_cast<std::size_t>(n);
+			const std::size_t c = std::min(to / x->k, x->cp.size() - 1);
+			if (c * x->k > pos) {
+				j.i = x->cp[c];
+				j.pos = c * x->k;
+			}
+			while (j.pos < to && valid(j.i)) {
+				j.step();
+			}
 
-	template <class I, class T = typename I::value_type>
-	inline auto prod(I i, T t = 1)
-	{
-		while (i) {
-			t *= *i;
-			++i;
+			return j;
 		}
+	};
 
-		return t;
-	}
+	template<class I>
+	struct is_infinite<indexed<I>> : is_infinite<I> {};
 
-	// d(i[1], i[0]), d(i[2], i[1]), ...
-	template <class I, class T = typename I::value_type, class D = std::minus<T>, 
-		typename U = std::invoke_result_t<D, T, T>>
-	class delta {
-		copy_assignable<D> d;
+	// Trace every n-th increment of i as a span named name.
+	// A pass through unless compiled with FMS_ITERABLE_TRACE.
+	template<class I>
+	class traced {
 		I i;
-		T t;
+		const char* name; // must outlive the trace
+		std::size_t n, k;
 	public:
 		using iterator_category = std::input_iterator_tag;
-		using value_type = U;
-		using reference = U&;
-		using pointer = U*;
-		using difference_type = std::ptrdiff_t;
+		using value_type = typename I::value_type;
+		using reference = typename I::reference;
+		using pointer = typename I::pointer;
+		using difference_type = typename I::difference_type;
 
-		constexpr delta() = default;
-		constexpr delta(const I& _i, D _d = std::minus<T>{})
-			: d(std::move(_d)), i(_i), t{}
+		traced(I i, const char* name, std::size_t n = 64)
+			: i(std::move(i)), name(name), n(n ? n : 1), k(0)
+		{ }
+		traced(const traced&) = default;
+		traced& operator=(const traced&) = default;
+		traced(traced&&) = default;
+		traced& operator=(traced&&) = default;
+		~traced() = default;
+
+		bool operator==(const traced& t) const
 		{
-			if (i) {
-				t = *i;
-				++i;
-			}
+			return i == t.i;
 		}
-		constexpr delta(const delta& _d) = default;
-		constexpr delta& operator=(const delta& _d) = default;
-		constexpr delta(delta&& _d) = default;
-		constexpr delta& operator=(delta&& _d) = default;
-		constexpr ~delta() = default;
 
-		constexpr bool operator==(const delta& _d) const
+		traced begin() const
 		{
-			return i == _d.i && t == _d.t;
+			return *this;
 		}
+		traced end() const
+			requires has_end<I>
+		{
+			auto e{ *this };
+			e.i = i.end();
 
-		constexpr explicit operator bool() const
+			return e;
+		}
+
+		explicit operator bool() const
 		{
-			return i.operator bool();
+			return valid(i);
 		}
-		constexpr value_type operator*() const
+		value_type operator*() const
 		{
-			return d(*i, t);
+			return *i;
 		}
-		constexpr delta& operator++() noexcept
+		traced& operator++()
 		{
-			if (i) {
-				t = *i;
+			if (++k == n) {
+				k = 0;
+				FMS_ITERABLE_SPAN(name, "stage");
+				++i;
+			}
+			else {
 				++i;
 			}
 
 			return *this;
 		}
-		constexpr delta operator++(int) noexcept
+		traced operator++(int)
 		{
 			auto tmp{ *this };
 
@@ -1520,61 +4487,141 @@ namespace fms::iterable {
 		}
 	};
 
-	// uptick + downtick = delta
-	template <class I, class T = typename I::value_type>
-	inline auto uptick(I i)
-	{
-		return delta(i, [](T a, T b) { return std::max<T>(b - a, 0); });
-	}
-	template <class I, class T = typename I::value_type>
-	inline auto downtick(I i)
+	template<class I>
+	struct is_infinite<traced<I>> : is_infinite<I> {};
+
+	// Name of T from the compiler.
+	template<class T>
+	constexpr std::string_view type_name()
 	{
-		return delta(i, [](T a, T b) { return std::min<T>(b - a, 0); });
+#if defined(_MSC_VER) && !defined(__clang__)
+		std::string_view s = __FUNCSIG__;
+		s.remove_prefix(s.find("type_name<") + 10);
+		s.remove_suffix(s.size() - s.rfind(">(void)"));
+#else
+		std::string_view s = __PRETTY_FUNCTION__;
+		s.remove_prefix(s.find("T = ") + 4);
+		const auto e = s.find(';'); // gcc appends "; std::string_view = ..."
+		s.remove_suffix(s.size() - (e != std::string_view::npos ? e : s.rfind(']')));
+#endif
+		return s;
 	}
 
-	template<class... Is>
-	class tuple {
-		std::tuple<Is...> is;
-	public:
-		using iterator_category = std::input_iterator_tag;
-		using value_type = std::tuple<typename Is::value_type...>;
-		using reference = value_type&;
-		using difference_type = std::ptrdiff_t;
-
-		constexpr tuple(Is... is)
-			: is(is...)
-		{ }
-		constexpr tuple(const tuple&) = default;
-		constexpr tuple& operator=(const tuple&) = default;
-		constexpr tuple(tuple&&) = default;
-		constexpr tuple& operator=(tuple&&) = default;
-		constexpr ~tuple() = default;
+	// Stage name and child stage types. Unknown types are leaves named by type_name.
+	template<class I>
+	struct stage_traits {
+		static constexpr std::string_view name = type_name<I>();
+		using children = std::tuple<>;
+	};
+#define FMS_ITERABLE_STAGE(NAME, PARAMS, ARGS, ...) \
+	template<PARAMS> struct stage_traits<NAME<ARGS>> { \
+		static constexpr std::string_view name = #NAME; \
+		using children = std::tuple<__VA_ARGS__>; \
+	};
+#define FMS_ITERABLE_COMMA ,
+	FMS_ITERABLE_STAGE(iota, class T, T)
+	FMS_ITERABLE_STAGE(power, class T, T)
+	FMS_ITERABLE_STAGE(factorial, class T, T)
+	FMS_ITERABLE_STAGE(choose, class T, T)
+	FMS_ITERABLE_STAGE(ptr, class T, T)
+	FMS_ITERABLE_STAGE(constant, class T, T)
+	FMS_ITERABLE_STAGE(interval, class I, I, I)
+	FMS_ITERABLE_STAGE(counted, class I FMS_ITERABLE_COMMA std::size_t N, I FMS_ITERABLE_COMMA N, I)
+	FMS_ITERABLE_STAGE(repeat, class I, I, I)
+	FMS_ITERABLE_STAGE(concatenate2, class I0 FMS_ITERABLE_COMMA class I1 FMS_ITERABLE_COMMA class T, I0 FMS_ITERABLE_COMMA I1 FMS_ITERABLE_COMMA T, I0, I1)
+	FMS_ITERABLE_STAGE(merge2, class I0 FMS_ITERABLE_COMMA class I1 FMS_ITERABLE_COMMA class T, I0 FMS_ITERABLE_COMMA I1 FMS_ITERABLE_COMMA T, I0, I1)
+	FMS_ITERABLE_STAGE(apply, class F FMS_ITERABLE_COMMA class I, F FMS_ITERABLE_COMMA I, I)
+	FMS_ITERABLE_STAGE(binop, class Op FMS_ITERABLE_COMMA class I0 FMS_ITERABLE_COMMA class I1, Op FMS_ITERABLE_COMMA I0 FMS_ITERABLE_COMMA I1, I0, I1)
+	FMS_ITERABLE_STAGE(filter, class P FMS_ITERABLE_COMMA class I, P FMS_ITERABLE_COMMA I, I)
+	FMS_ITERABLE_STAGE(until, class P FMS_ITERABLE_COMMA class I FMS_ITERABLE_COMMA class T, P FMS_ITERABLE_COMMA I FMS_ITERABLE_COMMA T, I)
+	FMS_ITERABLE_STAGE(fold, class Op FMS_ITERABLE_COMMA class I FMS_ITERABLE_COMMA class T, Op FMS_ITERABLE_COMMA I FMS_ITERABLE_COMMA T, I)
+	FMS_ITERABLE_STAGE(delta, class I FMS_ITERABLE_COMMA class T FMS_ITERABLE_COMMA class D FMS_ITERABLE_COMMA class U, I FMS_ITERABLE_COMMA T FMS_ITERABLE_COMMA D FMS_ITERABLE_COMMA U, I)
+	FMS_ITERABLE_STAGE(tuple, class... Is, Is..., Is...)
+	FMS_ITERABLE_STAGE(chunk, class I, I, I)
+	FMS_ITERABLE_STAGE(distinct, class I FMS_ITERABLE_COMMA class T, I FMS_ITERABLE_COMMA T, I)
+	FMS_ITERABLE_STAGE(shared_cursor, class I, I, I)
+	FMS_ITERABLE_STAGE(par_apply, class F FMS_ITERABLE_COMMA class I, F FMS_ITERABLE_COMMA I, I)
+	FMS_ITERABLE_STAGE(deadline, class I FMS_ITERABLE_COMMA class C, I FMS_ITERABLE_COMMA C, I)
+	FMS_ITERABLE_STAGE(indexed, class I, I, I)
+	FMS_ITERABLE_STAGE(traced, class I, I, I)
+#undef FMS_ITERABLE_COMMA
+#undef FMS_ITERABLE_STAGE
+
+	// Description of one pipeline stage and its sources.
+	struct stage {
+		std::string_view name;
+		std::string_view value_type;
+		std::size_t size; // sizeof stage including sources
+		bool infinite;
+		std::string_view category; // input, forward, bidirectional, random access, contiguous
+		std::size_t extent; // compile time size or std::dynamic_extent
+		std::vector<stage> children;
+
+		// One line per stage, sources indented.
+		std::string to_string(std::size_t indent = 0) const
+		{
+			std::string s(2 * indent, ' ');
+			s.append(name).append(" value_type=").append(value_type);
+			s.append(" sizeof=").append(std::to_string(size));
+			s.append(infinite ? " infinite " : " finite ").append(category);
+			if (extent != std::dynamic_extent) {
+				s.append(" extent=").append(std::to_string(extent));
+			}
+			s.append("\n");
+			for (const auto& c : children) {
+				s.append(c.to_string(indent + 1));
+			}
 
-		constexpr bool operator==(const tuple& t) const = default;
+			return s;
+		}
+	};
 
-		constexpr explicit operator bool() const
-		{
-			return std::apply([](auto... i) { return (i && ...); }, is);
+	template<class I>
+	constexpr std::string_view iterator_category_name()
+	{
+		using C = typename std::iterator_traits<I>::iterator_category;
+		if constexpr (is_contiguous_v<I>) {
+			return "contiguous";
 		}
-		constexpr value_type operator*() const
-		{
-			return std::apply([](auto... i) { return std::make_tuple(*i...); }, is);
+		else if constexpr (std::derived_from<C, std::random_access_iterator_tag>) {
+			return "random access";
 		}
-		constexpr tuple& operator++() noexcept
-		{
-			std::apply([](auto&... i) { (++i, ...); }, is);
-
-			return *this;
+		else if constexpr (std::derived_from<C, std::bidirectional_iterator_tag>) {
+			return "bidirectional";
 		}
-		constexpr tuple operator++(int) noexcept
-		{
-			auto tmp{ *this };
-
-			operator++();
-
-			return tmp;
+		else if constexpr (std::derived_from<C, std::forward_iterator_tag>) {
+			return "forward";
 		}
-	};
+		else {
+			return "input";
+		}
+	}
+
+	// Stage tree of pipeline type I.
+	template<class I>
+	inline stage describe()
+	{
+		stage s;
+		s.name = stage_traits<I>::name;
+		s.value_type = type_name<typename std::iterator_traits<I>::value_type>();
+		s.size = sizeof(I);
+		s.infinite = is_infinite_v<I>;
+		s.category = iterator_category_name<I>();
+		s.extent = std::dynamic_extent;
+		if constexpr (requires { I::extent; }) {
+			s.extent = I::extent;
+		}
+		[&s]<class... Is>(std::type_identity<std::tuple<Is...>>) {
+			(s.children.push_back(describe<Is>()), ...);
+		}(std::type_identity<typename stage_traits<I>::children>{});
+
+		return s;
+	}
+	template<class I>
+	inline stage describe(const I&)
+	{
+		return describe<I>();
+	}
 
 } // namespace fms::iterable
 
@@ -1587,7 +4634,8 @@ namespace fms::iterable {
 
 #define FMS_ITERABLE_OPERATOR_FUNCTION(OP, OP_) \
     template <class I, class J, class T = std::common_type_t<std::iter_value_t<I>, std::iter_value_t<J>>> \
-	constexpr auto operator OP(const I& i, const J& j) {  return fms::iterable::binop(std::OP_<T>{}, i, j); } \
+		requires fms::iterable::has_op_bool<std::remove_cvref_t<I>> && fms::iterable::has_op_bool<std::remove_cvref_t<J>> \
+	constexpr auto operator OP(I&& i, J&& j) {  return fms::iterable::binop(std::OP_<T>{}, std::forward<I>(i), std::forward<J>(j)); } \
 
 FMS_ITERABLE_OPERATOR(FMS_ITERABLE_OPERATOR_FUNCTION)
 #undef FMS_ITERABLE_OPERATOR_FUNCTION
@@ -1600,7 +4648,8 @@ FMS_ITERABLE_OPERATOR(FMS_ITERABLE_OPERATOR_FUNCTION)
 //}
 
 template<class I, class T = std::iter_value_t<I>>
-constexpr auto operator-(const I& i)
+	requires fms::iterable::has_op_bool<std::remove_cvref_t<I>>
+constexpr auto operator-(I&& i)
 {
-	return constant(T(-1)) * i;
+	return fms::iterable::constant(T(-1)) * std::forward<I>(i);
 }
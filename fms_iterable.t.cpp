@@ -1,9 +1,15 @@
 // fms_iterable.t.cpp - test fms_iterable.h
+#define FMS_ITERABLE_LIBSTDCXX_DEQUE
 #include <cassert>
+#include <chrono>
 #include <cmath>
+#include <deque>
 #include <list>
 #include <vector>
 #include "fms_iterable.h"
+#include "fms_iterable_latency.h"
+#include "fms_iterable_meter.h"
+#include "fms_iterable_perf.h"
 
 using namespace fms::iterable;
 
@@ -486,6 +492,1359 @@ int tuple_test()
 	return 0;
 }
 
+int chunk_test()
+{
+	{
+		int i[] = { 1, 2, 3, 4, 5 };
+		auto c = chunk(array(i), 2);
+		static_assert(std::same_as<decltype(*c), counted<ptr<int>>>);
+		assert(c);
+		assert(equal(*c, { 1, 2 }));
+		assert(&*(*c) == i); // no copy
+		++c;
+		assert(equal(*c, { 3, 4 }));
+		++c;
+		assert(equal(*c, { 5 }));
+		++c;
+		assert(!c);
+		assert(size(chunk(array(i), 2)) == 3);
+		assert(size(chunk(array(i), 5)) == 1);
+		assert(!chunk(empty<int>(), 2));
+	}
+	{
+		std::vector<int> v({ 1, 2, 3 });
+		auto c = chunk(make_interval(v), 2);
+		assert(equal(*c, { 1, 2 }));
+		assert(&*(*c) == v.data());
+		assert(equal(*++c, { 3 }));
+		assert(!++c);
+	}
+	{
+		auto c = chunk(filter(is_even, take(iota(1), 7)), 2);
+		static_assert(std::same_as<decltype(*c), counted<ptr<const int>>>);
+		auto c2{ c };
+		assert(c == c2);
+		c = c2;
+		assert(!(c2 != c));
+
+		assert(equal(*c, { 2, 4 }));
+		assert(equal(*c++, { 2, 4 }));
+		assert(equal(*c, { 6 }));
+		assert(!++c);
+	}
+	{
+		auto c = chunk(power(2), 3);
+		assert(equal(*c, { 1, 2, 4 }));
+		++c;
+		assert(equal(*c, { 8, 16, 32 }));
+	}
+
+	return 0;
+}
+
+int split_test()
+{
+	{
+		auto s = split("a,b,,c", ',');
+		auto s2{ s };
+		assert(s == s2);
+		s = s2;
+		assert(!(s2 != s));
+
+		assert(equal(s, { "a", "b", "", "c" }));
+		assert(size(s) == 4);
+	}
+	{
+		assert(!split("", ','));
+		assert(equal(split(",", ','), { "", "" }));
+		assert(equal(split("abc", ""), { "abc" }));
+		assert(equal(split("x y\tz ", " \t"), { "x", "y", "z", "" }));
+	}
+	{
+		// longer than one vector block
+		std::string_view line = "8=FIX.4.2|9=65|35=A|49=SERVER|56=CLIENT|34=177|52=20090107-18:15:16|98=0|108=30|10=062|";
+		auto s = split(line, "|=");
+		assert(starts_with(s, { "8", "FIX.4.2", "9", "65", "35", "A" }));
+		assert(size(s) == 21);
+		assert(*last(s) == "");
+		assert(equal(split(line, "|"), split(line, "||")));
+		std::size_t n = 0;
+		for (auto t : s) {
+			n += t.size() + 1;
+		}
+		assert(n == line.size() + 1);
+	}
+
+	return 0;
+}
+
+int hash_aggregate_test()
+{
+	namespace agg = aggregate;
+	{
+		flat_index<int> x;
+		assert(x.find(1) == x.npos);
+		for (int k = 0; k < 100; ++k) {
+			auto [id, inserted] = x.insert(k * 7);
+			assert(id == std::size_t(k) && inserted);
+		}
+		assert(!x.insert(14).second);
+		assert(x.find(14) == 2);
+		assert(x.find(15) == x.npos);
+		assert(x.size() == 100);
+	}
+	{
+		int k[] = { 3, 1, 3, 2, 1, 3 };
+		double v[] = { 1, 2, 3, 4, 5, 6 };
+		auto h = hash_group(tuple(array(k), array(v)), agg::sum<double>{}, agg::count<>{}, agg::min<double>{}, agg::max<double>{});
+		assert(h.size() == 3);
+		assert(equal(h.keys(), { 3, 1, 2 }));
+		assert(equal(h.values<0>(), { 10., 7., 4. }));
+		assert(equal(h.values<1>(), { 3u, 2u, 1u }));
+		assert(*h.find<2>(3) == 1);
+		assert(*h.find<3>(3) == 6);
+		assert(!h.find<0>(4));
+	}
+	{
+		std::vector<std::pair<int, int>> kv;
+		for (int i = 0; i < 1000; ++i) {
+			kv.emplace_back(i % 37, i);
+		}
+		auto i = counted(ptr(kv.data()), kv.size());
+		auto h = hash_group(i, agg::sum<int>{}, agg::count<int>{});
+		auto p = par_hash_group(i, 4, agg::sum<int>{}, agg::count<int>{});
+		assert(p.size() == 37);
+		for (int k = 0; k < 37; ++k) {
+			assert(p.find<0>(k) == h.find<0>(k));
+			assert(p.find<1>(k) == h.find<1>(k));
+		}
+		assert(sum(p.values<1>()) == 1000);
+	}
+
+	return 0;
+}
+
+int hash_join_test()
+{
+	using trade = std::tuple<int, double>; // symbol, price
+	using ref = std::tuple<int, char>; // symbol, exchange
+	const auto sym_t = [](const trade& t) { return std::get<0>(t); };
+	const auto sym_r = [](const ref& r) { return std::get<0>(r); };
+	{
+		ref r[] = { { 1, 'a' }, { 2, 'b' }, { 1, 'c' } };
+		trade t[] = { { 2, 10. }, { 3, 11. }, { 1, 12. } };
+		auto j = hash_join(array(r), array(t), sym_r, sym_t);
+		auto j2{ j };
+		assert(j == j2);
+		j = j2;
+		assert(!(j2 != j));
+
+		assert(j.partitions() == 1);
+		assert(size(j) == 3);
+		assert(*j == std::tuple(ref{ 2, 'b' }, trade{ 2, 10. }));
+		++j;
+		assert(*j == std::tuple(ref{ 1, 'a' }, trade{ 1, 12. }));
+		++j;
+		assert(*j == std::tuple(ref{ 1, 'c' }, trade{ 1, 12. }));
+		++j;
+		assert(!j);
+
+		assert(!hash_join(empty<ref>(), array(t), sym_r, sym_t));
+		assert(!hash_join(array(r), empty<trade>(), sym_r, sym_t));
+	}
+	{
+		std::vector<ref> r;
+		for (int k = 0; k < 1000; ++k) {
+			r.emplace_back(k % 500, char('a' + k % 26));
+		}
+		auto t = apply([](int k) { return trade(k, k); }, take(iota(0), 1000));
+		auto j = hash_join(make_interval(r), t, sym_r, sym_t, 8);
+		auto j1 = hash_join(make_interval(r), t, sym_r, sym_t, 1);
+		assert(j.partitions() == 8);
+		assert(size(j) == 1000);
+		while (j) {
+			assert(*j == *j1);
+			auto [rj, tj] = *j;
+			assert(std::get<0>(rj) == std::get<0>(tj));
+			++j;
+			++j1;
+		}
+		assert(!j1);
+	}
+
+	return 0;
+}
+
+// Value counting its copies.
+struct copied {
+	int k;
+	static inline std::size_t copies = 0;
+
+	copied(int k = 0)
+		: k(k)
+	{ }
+	copied(const copied& c)
+		: k(c.k)
+	{
+		++copies;
+	}
+	copied& operator=(const copied& c)
+	{
+		k = c.k;
+		++copies;
+
+		return *this;
+	}
+	copied(copied&&) = default;
+	copied& operator=(copied&&) = default;
+	~copied() = default;
+
+	bool operator==(const copied& c) const
+	{
+		return k == c.k;
+	}
+};
+template<>
+struct std::hash<copied> {
+	std::size_t operator()(const copied& c) const noexcept
+	{
+		return std::hash<int>{}(c.k);
+	}
+};
+
+int distinct_test()
+{
+	{
+		int i[] = { 3, 1, 3, 2, 1, 4, 2 };
+		auto d = distinct(array(i));
+		auto d2{ d };
+		assert(d == d2);
+		d = d2;
+		assert(!(d2 != d));
+
+		assert(equal(d, { 3, 1, 2, 4 }));
+		assert(!distinct(empty<int>()));
+
+		// copies traverse independently
+		assert(size(d) == 4);
+		assert(size(d) == 4);
+		auto e{ d };
+		++e;
+		assert(*e == 1 && *d == 3);
+		std::vector<int> v;
+		copy(d, back_insert_iterable(v));
+		assert(v == std::vector<int>({ 3, 1, 2, 4 }));
+		assert(equal(e, { 1, 2, 4 }));
+	}
+	{
+		auto d = distinct(apply([](int k) { return k % 10; }, take(iota(0), 1000)));
+		assert(equal(d, { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9 }));
+	}
+	{
+		// remember at least the last 2 distinct values
+		int i[] = { 1, 2, 1, 2, 3, 4, 5, 1 };
+		assert(equal(distinct(array(i), 2), { 1, 2, 3, 4, 5, 1 }));
+		assert(equal(distinct(array(i)), { 1, 2, 3, 4, 5 }));
+	}
+	{
+		// short lived copies do not copy the values seen
+		constexpr int n = 4096;
+		const auto make = []() { return distinct(apply([](int k) { return copied(k); }, take(iota(0), n))); };
+		copied::copies = 0;
+		int m = 0;
+		for (auto d = make(); d; ) {
+			assert((*d++).k == m++);
+		}
+		assert(m == n);
+		assert(copied::copies < 8 * n);
+
+		copied::copies = 0;
+		assert((*last(make())).k == n - 1);
+		assert(copied::copies < 8 * n);
+
+		copied::copies = 0;
+		auto d = make();
+		assert(starts_with(d, { copied(0), copied(1) }));
+		auto e{ d };
+		for (int k = 0; k < 10; ++k) {
+			++e;
+		}
+		for (int k = 0; k < 11; ++k) {
+			++d; // reuses values added by e
+		}
+		assert((*d).k == 11 && (*e).k == 10);
+		assert(copied::copies < 100);
+	}
+
+	return 0;
+}
+
+int bloom_test()
+{
+	{
+		int k[] = { 2, 3, 5, 7, 11, 13 };
+		bloom b(array(k));
+		for (int i : array(k)) {
+			assert(b.contains(i));
+		}
+		// no false negatives through filter
+		auto f = filter(std::cref(b), take(iota(0), 14));
+		assert(starts_with(f, { 2, 3, 5, 7, 11, 13 }));
+		assert(size(f) - 6 <= 1);
+	}
+	{
+		bloom<int> b(1000, 0.01);
+		b.add(take(iota(0), 1000));
+		auto fp = size(filter(std::cref(b), take(iota(1000), 100'000)));
+		assert(fp < 2'000);
+
+		std::vector<int> k(100);
+		copy(take(iota(950), 100), make_interval(k));
+		bool in[100];
+		b.contains(k.data(), k.size(), in);
+		for (std::size_t i = 0; i < 100; ++i) {
+			assert(in[i] == b.contains(k[i]));
+			assert(i >= 50 || in[i]);
+		}
+	}
+	for (double p : { 0., 1., -0.5, 2., std::nan("") }) {
+		bool thrown = false;
+		try {
+			bloom<int> b(10, p);
+		}
+		catch (const std::invalid_argument&) {
+			thrown = true;
+		}
+		assert(thrown);
+	}
+
+	return 0;
+}
+
+// Iterable owning its elements that counts copies.
+class heavy {
+	std::vector<int> v;
+	std::size_t k;
+public:
+	static inline int copies = 0;
+
+	using iterator_category = std::input_iterator_tag;
+	using value_type = int;
+	using reference = int&;
+	using pointer = int*;
+	using difference_type = std::ptrdiff_t;
+
+	heavy(std::initializer_list<int> v)
+		: v(v), k(0)
+	{ }
+	heavy(const heavy& h)
+		: v(h.v), k(h.k)
+	{
+		++copies;
+	}
+	heavy& operator=(const heavy& h)
+	{
+		v = h.v;
+		k = h.k;
+		++copies;
+
+		return *this;
+	}
+	heavy(heavy&&) = default;
+	heavy& operator=(heavy&&) = default;
+	~heavy() = default;
+
+	constexpr bool operator==(const heavy& h) const
+	{
+		return k == h.k && v == h.v;
+	}
+
+	explicit operator bool() const noexcept
+	{
+		return k < v.size();
+	}
+	int operator*() const
+	{
+		return v[k];
+	}
+	heavy& operator++()
+	{
+		++k;
+
+		return *this;
+	}
+	heavy operator++(int)
+	{
+		auto tmp{ *this };
+
+		operator++();
+
+		return tmp;
+	}
+};
+
+int move_test()
+{
+	{
+		heavy::copies = 0;
+		auto i = apply([](int k) { return k + 1; }, filter(is_even, take(heavy({ 1, 2, 3, 4 }), 3)));
+		assert(heavy::copies == 0);
+		assert(equal(i, { 3 }));
+	}
+	{
+		heavy::copies = 0;
+		auto i = concatenate(heavy({ 1 }), heavy({ 2 }), heavy({ 3 }));
+		auto j = merge(heavy({ 1, 3 }), heavy({ 2 }), heavy({ 0 }));
+		auto k = tuple(heavy({ 1 }), heavy({ 2 }));
+		assert(heavy::copies == 0);
+		assert(equal(i, { 1, 2, 3 }));
+		assert(equal(j, { 0, 1, 2, 3 }));
+	}
+	{
+		heavy::copies = 0;
+		auto i = heavy({ 1, 2 }) + heavy({ 3, 4 });
+		auto j = -delta(heavy({ 1, 2, 4 }));
+		auto k = fold(std::plus<int>{}, until([](int k) { return k > 2; }, heavy({ 1, 2, 3 })));
+		assert(heavy::copies == 0);
+		assert(equal(i, { 4, 6 }));
+		assert(equal(j, { -1, -2 }));
+		assert(equal(k, { 0, 1 }));
+	}
+	{
+		// lvalues are still copied
+		heavy h({ 1, 2 });
+		auto h2{ h };
+		heavy::copies = 0;
+		auto i = apply([](int k) { return k; }, h);
+		assert(heavy::copies == 1);
+		auto j = concatenate(h, std::move(h2));
+		assert(heavy::copies == 2);
+	}
+
+	return 0;
+}
+
+// Function object with a lookup table that counts copies.
+struct lookup {
+	std::vector<int> table;
+	static inline int copies = 0;
+
+	lookup(std::initializer_list<int> t)
+		: table(t)
+	{ }
+	lookup(const lookup& l)
+		: table(l.table)
+	{
+		++copies;
+	}
+	lookup& operator=(const lookup&) = delete;
+	lookup(lookup&&) = default;
+	~lookup() = default;
+
+	int operator()(int i) const
+	{
+		return table[i];
+	}
+};
+
+int copy_assignable_test()
+{
+	{
+		static_assert(sizeof(copy_assignable<lookup>) == sizeof(std::shared_ptr<const lookup>));
+		int x = 2;
+		auto f = [x](int i) { return x * i; };
+		static_assert(std::is_trivially_copyable_v<decltype(f)>);
+		assert(copy_assignable(f)(3) == 6);
+	}
+	{
+		lookup::copies = 0;
+		auto a = apply(lookup({ 1, 4, 9 }), take(iota(0), 3));
+		auto b{ a };
+		a = b;
+		assert(equal(a, { 1, 4, 9 }));
+		assert(equal(filter([](int i) { return i > 1; }, a), { 4, 9 }));
+		assert(lookup::copies == 0);
+
+		auto t = [t = std::vector<int>{ 0, 1 }](int i) { return t[i] == 1; };
+		auto u = until(t, iota(0));
+		for (int i = 0; i < 10; ++i) {
+			auto v{ u };
+			u = v;
+		}
+		assert(size(u) == 1);
+	}
+
+	return 0;
+}
+
+// Sum by pulling elements.
+template<class I>
+auto pull_sum(I i)
+{
+	std::iter_value_t<I> t = 0;
+	while (i) {
+		t += *i++;
+	}
+
+	return t;
+}
+
+int for_each_until_test()
+{
+	{
+		auto i = concatenate(take(iota(1), 3), filter(is_even, take(iota(1), 10)), until([](int i) { return i > 3; }, iota(1)));
+		assert(sum(i) == pull_sum(i));
+		auto j = delta(fold(std::plus<int>{}, take(iota(1), 5))) * take(constant(2), 3);
+		assert(sum(j) == pull_sum(j));
+		auto k = apply([](int i) { return i * i; }, take(iota(1), 5)) + iota(0);
+		assert(sum(k) == pull_sum(k));
+	}
+	{
+		// stop early
+		int n = 0;
+		auto i = concatenate(take(iota(1), 3), take(iota(4), 3));
+		assert(!for_each_until(i, [&n](int) { return ++n < 4; }));
+		assert(n == 4);
+	}
+	{
+		int o[3];
+		auto j = copy(concatenate(take(iota(1), 2), take(iota(3), 2)), array(o));
+		assert(!j);
+		assert(equal(array(o), { 1, 2, 3 }));
+	}
+
+	return 0;
+}
+
+// Infinite iterable that counts calls to operator bool().
+struct ones : public constant<int> {
+	static inline int checks = 0;
+
+	ones()
+		: constant<int>(1)
+	{ }
+	bool operator==(const ones&) const
+	{
+		return true;
+	}
+	explicit operator bool() const
+	{
+		++checks;
+
+		return true;
+	}
+};
+template<>
+struct fms::iterable::is_infinite<ones> : std::true_type {};
+
+// Finite iterable that counts calls to operator bool().
+class three {
+	int k;
+public:
+	static inline int checks = 0;
+
+	using iterator_category = std::input_iterator_tag;
+	using value_type = int;
+	using reference = int&;
+	using pointer = int*;
+	using difference_type = std::ptrdiff_t;
+
+	three()
+		: k(0)
+	{ }
+	bool operator==(const three&) const = default;
+
+	explicit operator bool() const
+	{
+		++checks;
+
+		return k < 3;
+	}
+	int operator*() const
+	{
+		return k;
+	}
+	three& operator++()
+	{
+		++k;
+
+		return *this;
+	}
+	three operator++(int)
+	{
+		auto tmp{ *this };
+
+		operator++();
+
+		return tmp;
+	}
+};
+
+int is_infinite_test()
+{
+	static_assert(is_infinite_v<iota<int>>);
+	static_assert(!is_infinite_v<counted<iota<int>>>);
+	static_assert(is_infinite_v<decltype(power(2.) / factorial())>);
+	static_assert(!is_infinite_v<decltype(take(iota(0), 2) * iota(0))>);
+	static_assert(is_infinite_v<decltype(concatenate(take(iota(0), 2), iota(0)))>);
+	static_assert(is_infinite_v<decltype(apply([](int i) { return i; }, iota(0)))>);
+	static_assert(!is_infinite_v<decltype(filter(is_even, iota(0)))>);
+	static_assert(is_infinite_v<decltype(tuple(iota(0), constant(1)))>);
+	{
+		// a + b * iota(0) checks only a
+		auto x = three() + ones() * ones();
+		ones::checks = three::checks = 0;
+		int n = 0;
+		while (x) {
+			n += *x;
+			++x;
+		}
+		assert(n == 0 + 1 + 2 + 3);
+		assert(three::checks == 4);
+		assert(ones::checks == 0);
+	}
+	{
+		auto t = tuple(three(), ones());
+		ones::checks = 0;
+		assert(size(t) == 3);
+		assert(ones::checks == 0);
+	}
+
+	return 0;
+}
+
+int fixed_test()
+{
+	{
+		constexpr int t = [] {
+			int t = 0;
+			auto i = take<3>(iota(1));
+			for_each_until(i, [&t](int u) { t += u; return true; });
+
+			return t;
+		}();
+		static_assert(t == 1 + 2 + 3);
+		static_assert(decltype(take<3>(iota(1)))::extent == 3);
+	}
+	{
+		double a[] = { 1, 2, 3 };
+		double b[] = { 4, 5, 6 };
+		auto x = fixed(a);
+		auto x2{ x };
+		assert(x == x2);
+		x = x2;
+		assert(!(x2 != x));
+
+		assert(size(x) == 3);
+		assert(equal(x, array(a)));
+		assert(x[2] == 3);
+		assert(sum(fixed(a) * fixed(b)) == 4 + 10 + 18);
+		++x;
+		assert(sum(x) == 5);
+		assert(*last(x) == 3);
+
+		double c[3];
+		copy(fixed(b), fixed(c));
+		assert(equal(fixed(c), { 4., 5., 6. }));
+	}
+	{
+		int n = 0;
+		auto i = take<4>(iota(0));
+		assert(!for_each_until(i, [&n](int u) { n += u; return u < 2; }));
+		assert(n == 0 + 1 + 2);
+		assert(!take<0>(iota(0)));
+	}
+
+	return 0;
+}
+
+int block_reduce_test()
+{
+	{
+		int i[] = { 1, 2, 3, 4, 5 };
+		assert(block_reduce(array(i), std::plus<int>{}, 0, 2) == 15);
+		assert(block_reduce(array(i), std::multiplies<int>{}, 1, 2) == 120);
+		assert(block_reduce(empty<int>(), std::plus<int>{}) == 0);
+		assert(par_block_reduce(array(i), std::plus<int>{}, 0, 3, 2) == 15);
+		// b = 0 is a single block
+		assert(block_reduce(array(i), std::plus<int>{}, 0, 0) == 15);
+		assert(par_block_reduce(array(i), std::plus<int>{}, 0, 3, 0) == 15);
+		assert(par_block_reduce(empty<int>(), std::plus<int>{}, 0, 3, 0) == 0);
+		std::list<int> l;
+		static_assert(!std::random_access_iterator<decltype(make_interval(l))>); // no par_block_reduce
+	}
+	{
+		std::vector<double> v;
+		copy(take(apply([](int k) { return std::sin(k) * std::pow(10., k % 17 - 8); }, iota(0)), 100'000), back_insert_iterable(v));
+		auto i = make_interval(v);
+		const double s = block_reduce(i, std::plus<double>{}, 0., 256);
+		for (std::size_t threads : { 1, 2, 3, 7 }) {
+			assert(par_block_reduce(i, std::plus<double>{}, 0., threads, 256) == s);
+		}
+		assert(std::fabs(s - sum(i)) <= 1e-6 * std::fabs(s) + 1e-6);
+	}
+
+	return 0;
+}
+
+int shared_cursor_test()
+{
+	{
+		int i[] = { 1, 2, 3, 4, 5 };
+		auto c = shared_cursor(array(i), 2);
+		auto c2{ c };
+		assert(equal(*c, { 1, 2 }));
+		assert(equal(*c2, { 3, 4 })); // copies share the cursor
+		++c;
+		assert(equal(*c, { 5 }));
+		assert(!++c);
+		assert(!++c2);
+	}
+	{
+		int i[] = { 1, 2, 3, 4, 5 };
+		auto c = shared_cursor(array(i), 2);
+		auto c2{ c };
+		assert(c == c2); // both unclaimed
+		assert(c != c.end());
+		assert(c2 != c.end());
+		assert(equal(*c, { 1, 2 })); // comparison did not claim
+		assert(c != c2);
+		auto b = c2.begin();
+		assert(equal(*b, { 3, 4 }));
+	}
+	{
+		std::vector<int> v;
+		copy(take(iota(1), 10'000), back_insert_iterable(v));
+		auto c = shared_cursor(counted(ptr(v.data()), v.size()), 64);
+		std::atomic<long> total = 0, chunks = 0;
+		std::vector<std::thread> ts;
+		for (int t = 0; t < 4; ++t) {
+			ts.emplace_back([c, &total, &chunks]() {
+				for (auto chunk : c) {
+					total += sum(chunk);
+					++chunks;
+				}
+			});
+		}
+		for (auto& t : ts) {
+			t.join();
+		}
+		assert(total == 10'000L * 10'001 / 2);
+		assert(chunks == (10'000 + 63) / 64);
+	}
+
+	return 0;
+}
+
+int par_apply_test()
+{
+	{
+		std::atomic<int> running = 0, most = 0;
+		auto slow = [&](int i) {
+			most = std::max<int>(most, ++running);
+			std::this_thread::sleep_for(std::chrono::microseconds(100 * (i % 7)));
+			--running;
+
+			return i * i;
+		};
+		auto a = par_apply(slow, filter(is_even, take(iota(0), 100)), 4, 3);
+		auto a2{ a };
+		assert(a == a2);
+		a = a2;
+		assert(!(a2 != a));
+
+		std::vector<int> v;
+		copy(apply([](int i) { return i * i; }, filter(is_even, take(iota(0), 100))), back_insert_iterable(v));
+		assert(equal(a, make_interval(v)));
+		assert(most <= 3);
+	}
+	{
+		assert(!par_apply([](int i) { return i; }, empty<int>(), 2));
+		int n = 0;
+		for (auto i : par_apply([](int i) { return i + 1; }, take(iota(0), 10), 3)) {
+			assert(i == ++n);
+		}
+		assert(n == 10);
+	}
+	{
+		auto a = par_apply([](int i) { if (i == 2) throw i; return i; }, take(iota(0), 5), 2, 2);
+		assert(*a == 0);
+		++a;
+		assert(*a == 1);
+		bool thrown = false;
+		try {
+			++a;
+		}
+		catch (int i) {
+			thrown = i == 2;
+		}
+		assert(thrown);
+	}
+	{
+		// exceptions from the source are delivered in order
+		auto a = par_apply([](int i) { return i; }, apply([](int i) { if (i == 3) throw i; return i; }, iota(0)), 2, 2);
+		int n = 0;
+		bool thrown = false;
+		try {
+			for (; a; ++a) {
+				assert(*a == n++);
+			}
+		}
+		catch (int i) {
+			thrown = i == 3;
+		}
+		assert(thrown);
+		assert(n == 3);
+	}
+
+	return 0;
+}
+
+int deadline_test()
+{
+	using namespace std::chrono_literals;
+	{
+		auto d = deadline(take(iota(0), 10), 1h);
+		auto d2{ d };
+		assert(d == d2);
+		d = d2;
+		assert(!(d2 != d));
+
+		assert(sum(d) == 45);
+		while (d) {
+			++d;
+		}
+		assert(!d.truncated());
+		assert(!deadline(iota(0), 0s));
+	}
+	{
+		auto slow = [](int i) {
+			std::this_thread::sleep_for(100us);
+
+			return i;
+		};
+		auto d = deadline(apply(slow, iota(0)), 1ms, 4);
+		int n = 0;
+		while (d) {
+			assert(*d == n); // runs slow
+			++d;
+			++n;
+		}
+		assert(n > 0 && n % 4 == 0);
+		assert(d.truncated());
+
+		auto e = deadline(apply(slow, iota(0)), 1ms, 4);
+		assert(for_each_until(e, [](int) { return true; }));
+		assert(e.truncated());
+	}
+
+	return 0;
+}
+
+int metered_test()
+{
+	const auto name = "/fms_iterable_test." + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+	{
+		meter_segment s(name, 2);
+		auto m = metered(take(iota(0), 100), "iota", s, 8);
+		auto m2{ m };
+		assert(m == m2);
+		m = m2;
+
+		assert(sum(m) == 4950); // for_each_until
+		while (m) {
+			++m;
+		}
+		assert(s.size() == 1);
+		assert(s[0].elements == 200);
+		assert(s[0].width == sizeof(int));
+
+		meter_segment r(name, 0);
+		assert(r.is_shared() == s.is_shared());
+		if (r.is_shared()) {
+			assert(r.size() == 1);
+			assert(std::string_view(r[0].name) == "iota");
+			assert(r[0].ready && r[0].elements == 200);
+		}
+		assert(!r.add("r", 1)); // read only
+		{
+			meter_segment s2(name, 2); // exists, so process memory
+			assert(!s2.is_shared() || !s.is_shared());
+			assert(s2.add("z", 1));
+		}
+		if (r.is_shared()) {
+			meter_segment r2(name, 0); // not clobbered or removed by s2
+			assert(r2.is_shared() && r2.size() == 1);
+			assert(std::string_view(r2[0].name) == "iota");
+		}
+
+		assert(s.add("x", 1));
+		assert(!s.add("y", 1)); // full
+		auto f = metered(take(iota(0), 3), "full", s);
+		assert(sum(f) == 3);
+		assert(s.size() == 2);
+	}
+	{
+		meter_segment r(name, 0); // removed
+		assert(!r.is_shared() && r.size() == 0);
+	}
+#ifdef FMS_ITERABLE_SHM
+	{
+		// header claims more slots than the segment holds
+		const int fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+		assert(fd != -1);
+		assert(::ftruncate(fd, sizeof(meter_header)) == 0);
+		meter_header h{ meter_header::fourcc, 1000, {}, 0 };
+		h.count.store(1000);
+		assert(::write(fd, &h, sizeof(h)) == sizeof(h));
+		::close(fd);
+
+		meter_segment r(name, 0);
+		assert(!r.is_shared() && r.size() == 0);
+		::shm_unlink(name.c_str());
+	}
+	{
+		// left by a process that exited
+		const int fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+		assert(fd != -1);
+		meter_header h{ meter_header::fourcc, 0, {}, 0x7fffffff };
+		assert(::write(fd, &h, sizeof(h)) == sizeof(h));
+		::close(fd);
+
+		meter_segment s(name, 2);
+		assert(s.is_shared());
+		meter_segment r(name, 0);
+		assert(r.is_shared());
+	}
+	{
+		meter_segment r(name, 0); // removed
+		assert(!r.is_shared());
+	}
+#endif
+	{
+		// slots are reused after the last copy is gone
+		meter_segment s(name, 1);
+		for (int k = 1; k <= 10; ++k) {
+			auto m = metered(take(iota(0), k), "short", s);
+			auto m2{ m };
+			assert(sum(m2) == k * (k - 1) / 2);
+		}
+		assert(s.size() == 1);
+		assert(s[0].ready == 2 && s[0].elements == 10);
+		assert(std::string_view(s[0].name) == "short");
+	}
+
+	return 0;
+}
+
+int collect_small_test()
+{
+	{
+		auto b = collect_small<4>(take(iota(0), 3));
+		static_assert(std::is_same_v<decltype(b.view()), counted<ptr<int>>>);
+		assert(!b.spilled());
+		assert(b.size() == 3);
+		assert(equal(b.view(), take(iota(0), 3)));
+		assert(sum(b.view()) == 3);
+		const auto& c = b;
+		assert(c[2] == 2);
+		assert(size(c.view()) == 3);
+
+		b.push_back(3);
+		assert(!b.spilled() && b.size() == 4);
+		b.push_back(4);
+		assert(b.spilled() && b.size() == 5);
+		assert(equal(b.view(), take(iota(0), 5)));
+	}
+	{
+		auto b = collect_small<2>(take(iota(0), 10));
+		assert(b.spilled());
+		assert(equal(b.view(), take(iota(0), 10)));
+		b.clear();
+		assert(!b.spilled() && b.size() == 0);
+		assert(!b.view());
+	}
+	{
+		auto b = collect_small<4>(choose(4));
+		assert(equal(b.view(), choose(4)));
+	}
+	{
+		small_buffer<std::string, 2> b;
+		b.push_back("a");
+		b.push_back("b");
+		auto b2{ b };
+		assert(b2.size() == 2 && b2[1] == "b");
+		auto b3{ std::move(b2) };
+		assert(b3.size() == 2 && b2.size() == 0);
+		b3.push_back("c");
+		b = b3;
+		assert(b.spilled() && b[2] == "c");
+		b2 = std::move(b);
+		assert(b2.size() == 3 && b.size() == 0);
+		b2 = b3;
+		assert(b2.size() == 3);
+	}
+
+	return 0;
+}
+
+int indexed_test()
+{
+	{
+		int calls = 0;
+		auto f = [&calls](int i) { ++calls; return i; };
+		auto i = indexed(filter([](int j) { return j % 2 == 0; }, apply(f, iota(0))), 8);
+		auto i2{ i };
+		assert(i == i2);
+		i = i2;
+		assert(!(i2 != i));
+
+		auto j = drop(i, 100); // first traversal records checkpoints
+		assert(*j == 200);
+		assert(j.position() == 100);
+		assert(i.checkpoints() == 1 + 100 / 8);
+
+		calls = 0;
+		auto k = drop(i, 50);
+		assert(*k == 100 && k.position() == 50);
+		assert(calls < 2 * 8); // at most 7 replayed elements, 2 calls each
+		k = drop(k, 3);
+		assert(*k == 106);
+		assert(*drop(i, 0) == 0);
+		assert(*drop(j, 1) == 202);
+	}
+	{
+		auto i = indexed(take(iota(0), 10), 4);
+		assert(sum(i) == 45);
+		assert(!drop(i, 20));
+		assert(*drop(i, 9) == 9);
+		assert(i.checkpoints() == 3);
+		auto j = drop(i, 5);
+		assert(equal(take(j, 5), take(iota(5), 5)));
+		static_assert(!noexcept(drop(i, 5))); // may allocate checkpoints
+		const auto t = take(iota(0), 10);
+		static_assert(noexcept(drop(t, 5)));
+	}
+
+	return 0;
+}
+
+int archive_test()
+{
+	{
+		auto i = iota(0);
+		++i;
+		archive a;
+		save(i, a);
+		auto j = iota(0);
+		archive b(a.bytes());
+		load(j, b);
+		assert(b);
+		assert(*j == 1);
+		load(j, b);
+		assert(!b); // past end
+	}
+	{
+		// running sum of squares of the evens, with deltas
+		auto make = []() {
+			auto e = filter([](int i) { return i % 2 == 0; }, iota(0));
+			return delta(fold(std::plus<int>{}, apply([](int i) { return i * i; }, e), 0));
+		};
+		auto p = make();
+		for (int n = 0; n < 10; ++n) {
+			++p;
+		}
+		archive a;
+		save(p, a);
+
+		auto q = make();
+		archive b(a.bytes());
+		load(q, b);
+		assert(b);
+		assert(equal(take(p, 5), take(q, 5)));
+	}
+	{
+		auto make = []() {
+			return tuple(concatenate(take(iota(0), 3), take(power(2), 3)), merge(take(iota(0), 4), take(iota(0), 4)), choose(5));
+		};
+		auto p = make();
+		++p;
+		++p;
+		++p;
+		++p;
+		archive a;
+		save(p, a);
+		auto q = make();
+		archive b(a.bytes());
+		load(q, b);
+		assert(b);
+		while (p) {
+			assert(*p == *q);
+			++p;
+			++q;
+		}
+		assert(!q);
+	}
+	{
+		auto p = take<3>(factorial<double>());
+		++p;
+		auto q = take<3>(factorial<double>());
+		archive a;
+		save(p, a);
+		load(q, a);
+		assert(equal(p, q));
+		static_assert(!savable<ptr<int>>);
+		int i[] = { 1, 2, 3 };
+		static_assert(!savable<decltype(array(i))>);
+		static_assert(!savable<decltype(apply([](int j) { return j; }, array(i)))>);
+		static_assert(savable<decltype(take(iota(0), 3))>);
+		// addresses do not survive a restart
+		std::vector<int> v;
+		static_assert(!savable<int*>);
+		static_assert(!savable<decltype(make_interval(v))>);
+		static_assert(!savable<decltype(apply([](int j) { return j; }, make_interval(v)))>);
+		static_assert(!savable<decltype(split(std::string_view("a b"), ' '))>);
+		static_assert(savable<int> && savable<double>);
+	}
+
+	return 0;
+}
+
+int perf_test()
+{
+	constexpr std::size_t n = 100'000;
+	perf_scope p;
+	assert(sum(take(iota<std::size_t>(0), n)) == n * (n - 1) / 2);
+	const auto c = p.read();
+	if (p.available()) {
+		bool any = false;
+		for (const auto& e : c.count) {
+			any = any || e.has_value();
+		}
+		assert(any);
+		if (const auto i = c.per(perf_event::instructions, n)) {
+			assert(*i > 0);
+		}
+	}
+	else {
+		assert(!c[perf_event::cycles] && !c.ipc());
+		assert(!c.per(perf_event::instructions, n));
+	}
+	assert(!c.per(perf_event::cycles, 0));
+
+	return 0;
+}
+
+int describe_test()
+{
+	static_assert(type_name<int>() == "int");
+	{
+		auto p = binop(std::divides<double>{}, power(2.), factorial<double>());
+		const auto d = describe(p);
+		assert(d.name == "binop");
+		assert(d.value_type == "double");
+		assert(d.size == sizeof(p));
+		assert(d.infinite);
+		assert(d.children.size() == 2);
+		assert(d.children[0].name == "power" && d.children[1].name == "factorial");
+		assert(d.children[1].children.empty());
+		assert(d.to_string().find("\n  factorial value_type=double") != std::string::npos);
+	}
+	{
+		double a[] = { 1, 2, 3 };
+		const auto d = describe(apply([](double x) { return x * x; }, fixed(a)));
+		assert(!d.infinite);
+		assert(d.category == "input");
+		const auto& c = d.children[0];
+		assert(c.name == "counted" && c.extent == 3);
+		assert(c.category == "contiguous");
+		assert(c.children[0].name == "ptr");
+		assert(describe(array(a)).extent == std::dynamic_extent);
+	}
+	{
+		const auto d = describe<split>();
+		assert(d.name.find("split") != std::string_view::npos);
+		assert(d.value_type.find("string_view") != std::string_view::npos);
+	}
+
+	return 0;
+}
+
+int traced_test()
+{
+	// pass through without FMS_ITERABLE_TRACE, see fms_iterable_trace.t.cpp
+	auto t = traced(take(iota(0), 100), "iota", 10);
+	auto t2{ t };
+	assert(t == t2);
+	t = t2;
+	assert(sum(t) == 4950);
+	int n = 0;
+	while (t) {
+		++t;
+		++n;
+	}
+	assert(n == 100);
+
+	return 0;
+}
+
+int latency_test()
+{
+	{
+		using L = log_linear<>;
+		static_assert(L::index(0) == 0 && L::index(63) == 63);
+		static_assert(L::index(64) == 64 && L::index(65) == 64 && L::index(66) == 65);
+		static_assert(L::index(~std::uint64_t(0)) == L::buckets - 1);
+		for (std::size_t k = 0; k < L::buckets; ++k) {
+			assert(L::index(L::lower(k)) == k);
+			assert(L::index(L::upper(k)) == k);
+		}
+	}
+	{
+		latency_histogram h;
+		auto p = unstamp(apply(keep_stamp([](int i) { return 2 * i; }), filter([](int i) { return i % 3 != 0; }, stamp(take(iota(0), 100)))), h);
+		auto p2{ p };
+		assert(p == p2);
+		p = p2;
+		static_assert(std::is_same_v<decltype(*p), int>);
+		assert(*p == 2);
+
+		assert(sum(p) == 2 * (4950 - 3 * 561));
+		assert(h.read().count() == 66);
+		while (p) {
+			++p;
+		}
+		const auto r = h.read();
+		assert(r.count() == 2 * 66);
+		assert(r.percentile(0) <= r.percentile(0.5));
+		assert(r.percentile(0.5) <= r.percentile(1));
+		assert(r.mean() > 0);
+	}
+	{
+		latency_histogram h;
+		const auto run = [&h]() {
+			assert(sum(unstamp(stamp(take(iota(0), 1000), 10), h)) == 499500);
+		};
+		std::thread t(run);
+		run();
+		t.join();
+		assert(h.read().count() == 2 * 100);
+	}
+	{
+		// the source runs once per element when pulled
+		latency_histogram h;
+		int calls = 0;
+		auto p = unstamp(apply(keep_stamp([&calls](int i) { return ++calls, i; }), stamp(take(iota(0), 10))), h);
+		int n = 0;
+		while (p) {
+			assert(*p == n++);
+			++p;
+		}
+		assert(calls == 10);
+		assert(h.read().count() == 10);
+	}
+	{
+		// stopping early leaves the current element to operator++
+		latency_histogram h;
+		auto p = unstamp(stamp(take(iota(0), 10)), h);
+		assert(*p == 0);
+		assert(!for_each_until(p, [](int i) { return i < 5; }));
+		assert(*p == 5);
+		assert(h.read().count() == 5);
+		++p;
+		assert(h.read().count() == 6);
+		while (p) {
+			++p;
+		}
+		assert(h.read().count() == 10);
+	}
+	{
+		// histograms used alternately on one thread
+		latency_histogram h0, h1;
+		for (int k = 0; k < 10; ++k) {
+			h0.record(1);
+			h1.record(2);
+			h1.record(3);
+		}
+		assert(h0.read().count() == 10);
+		assert(h1.read().count() == 20);
+	}
+
+	return 0;
+}
+
+int segmented_test()
+{
+	{
+		std::deque<int> d;
+		for (int k = 0; k < 1000; ++k) {
+			d.push_back(k);
+		}
+#if defined(FMS_ITERABLE_LIBSTDCXX_DEQUE) && defined(__GLIBCXX__)
+		static_assert(segmented<std::deque<int>::iterator>);
+		static_assert(segmented<std::deque<int>::const_iterator>);
+#else
+		static_assert(!segmented<std::deque<int>::iterator>);
+#endif
+		static_assert(!segmented<std::vector<int>::iterator>);
+		auto i = make_interval(d);
+		assert(sum(i) == 499500);
+		assert(equal(i, take(iota(0), 1000)));
+		assert(compare(i, take(iota(0), 999)) > 0);
+		assert(compare(i, take(iota(0), 1001)) < 0);
+		assert(compare(i, take(iota(1), 1000)) < 0);
+		assert(block_reduce(i, std::plus<int>{}, 0, 100) == 499500);
+
+		std::vector<int> v(1000);
+		copy(i, make_interval(v));
+		assert(v[999] == 999);
+
+		auto j = drop(i, 500);
+		int n = 0;
+		assert(!for_each_until(j, [&n](int t) { return ++n, t < 700; }));
+		assert(n == 201 && *j == 700);
+	}
+	{
+		chunked_vector<int, 8> c;
+		static_assert(segmented<chunked_vector<int, 8>::iterator>);
+		static_assert(std::random_access_iterator<chunked_vector<int, 8>::const_iterator>);
+		static_assert(!std::is_convertible_v<std::vector<std::vector<int>>*, chunked_vector<int, 8>::iterator>);
+		for (int k = 0; k < 100; ++k) {
+			c.push_back(k);
+		}
+		const int* p = &c[3];
+		c.push_back(100); // no element moves
+		assert(p == &c[3] && c.size() == 101);
+		assert(c.blocks() == 13);
+		assert(size(c.block(12)) == 5);
+
+		const auto& cc = c;
+		auto i = make_interval(cc);
+		assert(sum(i) == 5050);
+		assert(equal(i, take(iota(0), 101)));
+		assert(block_reduce(i, std::plus<int>{}, 0, 7) == 5050);
+		assert(*last(i) == 100);
+		assert(i[50] == 50);
+
+		auto m = make_interval(c);
+		copy(take(constant(1), 101), m);
+		assert(sum(make_interval(c)) == 101);
+
+		auto c2{ c };
+		auto c3{ std::move(c) };
+		assert(c2.size() == 101 && c3.size() == 101 && c.empty());
+		assert(equal(make_interval(c2), make_interval(c3)));
+		c = c2;
+		const int* q = &c[96];
+		for (int k = 0; k < 3; ++k) {
+			c.push_back(k); // copied last block keeps capacity B
+		}
+		assert(q == &c[96] && c.size() == 104);
+	}
+
+	return 0;
+}
+
 int main()
 {
 	drop_test();
@@ -504,6 +1863,30 @@ int main()
 	delta_test();
 	exp_test();
 	tuple_test();
+	chunk_test();
+	split_test();
+	hash_aggregate_test();
+	hash_join_test();
+	distinct_test();
+	bloom_test();
+	move_test();
+	copy_assignable_test();
+	for_each_until_test();
+	is_infinite_test();
+	fixed_test();
+	block_reduce_test();
+	shared_cursor_test();
+	par_apply_test();
+	deadline_test();
+	metered_test();
+	collect_small_test();
+	indexed_test();
+	archive_test();
+	perf_test();
+	describe_test();
+	traced_test();
+	latency_test();
+	segmented_test();
 
 	return 0;
 }
@@ -0,0 +1,143 @@
+// fms_iterable_alloc.h - count heap allocations
+// Define FMS_ITERABLE_ALLOC_NEW before including in exactly one translation
+// unit to replace global operator new/delete with counting versions.
+// Replacing them hides new/delete from sanitizers, so use a separate executable.
+#pragma once
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+namespace fms::iterable {
+
+	// Allocations by this thread since it started.
+	struct alloc_count {
+		static inline thread_local std::size_t allocations = 0;
+		static inline thread_local std::size_t bytes = 0;
+	};
+
+	// Allocations by this thread while in scope.
+	class alloc_scope {
+		std::size_t n, b;
+	public:
+		alloc_scope() noexcept
+			: n(alloc_count::allocations), b(alloc_count::bytes)
+		{ }
+		alloc_scope(const alloc_scope&) = delete;
+		alloc_scope& operator=(const alloc_scope&) = delete;
+		~alloc_scope() = default;
+
+		std::size_t allocations() const noexcept
+		{
+			return alloc_count::allocations - n;
+		}
+		std::size_t bytes() const noexcept
+		{
+			return alloc_count::bytes - b;
+		}
+	};
+
+	// Number of allocations made by f() after warmup calls to reach steady state.
+	template<class F>
+	inline std::size_t allocations(F&& f, std::size_t warmup = 0)
+	{
+		while (warmup--) {
+			f();
+		}
+		alloc_scope s;
+		f();
+
+		return s.allocations();
+	}
+
+} // namespace fms::iterable
+
+#ifdef FMS_ITERABLE_ALLOC_NEW
+
+namespace fms::iterable::detail {
+
+	inline void* counted_new(std::size_t n, std::size_t a = 0)
+	{
+		++alloc_count::allocations;
+		alloc_count::bytes += n;
+		if (n == 0) {
+			n = 1;
+		}
+		// Call the new handler until it frees enough memory or throws.
+		for (;;) {
+#ifdef _MSC_VER
+			void* p = a ? _aligned_malloc(n, a) : std::malloc(n);
+#else
+			void* p = a ? std::aligned_alloc(a, (n + a - 1) / a * a) : std::malloc(n);
+#endif
+			if (p) {
+				return p;
+			}
+			const auto h = std::get_new_handler();
+			if (!h) {
+				throw std::bad_alloc{};
+			}
+			h();
+		}
+	}
+	inline void counted_delete(void* p, bool aligned = false) noexcept
+	{
+#ifdef _MSC_VER
+		aligned ? _aligned_free(p) : std::free(p);
+#else
+		(void)aligned;
+		std::free(p);
+#endif
+	}
+
+} // namespace fms::iterable::detail
+
+void* operator new(std::size_t n)
+{
+	return fms::iterable::detail::counted_new(n);
+}
+void* operator new[](std::size_t n)
+{
+	return fms::iterable::detail::counted_new(n);
+}
+void* operator new(std::size_t n, std::align_val_t a)
+{
+	return fms::iterable::detail::counted_new(n, static_cast<std::size_t>(a));
+}
+void* operator new[](std::size_t n, std::align_val_t a)
+{
+	return fms::iterable::detail::counted_new(n, static_cast<std::size_t>(a));
+}
+void operator delete(void* p) noexcept
+{
+	fms::iterable::detail::counted_delete(p);
+}
+void operator delete[](void* p) noexcept
+{
+	fms::iterable::detail::counted_delete(p);
+}
+void operator delete(void* p, std::size_t) noexcept
+{
+	fms::iterable::detail::counted_delete(p);
+}
+void operator delete[](void* p, std::size_t) noexcept
+{
+	fms::iterable::detail::counted_delete(p);
+}
+void operator delete(void* p, std::align_val_t) noexcept
+{
+	fms::iterable::detail::counted_delete(p, true);
+}
+void operator delete[](void* p, std::align_val_t) noexcept
+{
+	fms::iterable::detail::counted_delete(p, true);
+}
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept
+{
+	fms::iterable::detail::counted_delete(p, true);
+}
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept
+{
+	fms::iterable::detail::counted_delete(p, true);
+}
+
+#endif // FMS_ITERABLE_ALLOC_NEW
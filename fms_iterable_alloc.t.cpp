@@ -0,0 +1,84 @@
+// fms_iterable_alloc.t.cpp - test fms_iterable_alloc.h
+// Separate from fms_iterable.t since it replaces global operator new/delete.
+#include <cassert>
+#include <new>
+#include <vector>
+#include "fms_iterable.h"
+#define FMS_ITERABLE_ALLOC_NEW
+#include "fms_iterable_alloc.h"
+
+using namespace fms::iterable;
+
+int alloc_test()
+{
+	{
+		alloc_scope s;
+		int* p = new int(1);
+		delete p;
+		std::vector<int> v(10);
+		assert(s.allocations() == 2);
+		assert(s.bytes() >= sizeof(int) + 10 * sizeof(int));
+	}
+	{
+		int k = 2;
+		auto p = filter([](int i) { return i % 2 == 0; }, apply([k](int i) { return k * i; }, iota(0)));
+		assert(0 == allocations([&]() {
+			auto q{ p };
+			q = p;
+			assert(sum(take(q, 100)) == 2 * 4950);
+		}));
+		assert(0 == allocations([]() {
+			auto b = collect_small<4>(take(iota(0), 4));
+			assert(b.size() == 4);
+		}));
+		assert(0 < allocations([]() {
+			auto b = collect_small<4>(take(iota(0), 5));
+			assert(b.spilled());
+		}));
+	}
+	{
+		std::vector<int> v;
+		v.reserve(16);
+		const auto fill = [&v]() {
+			v.clear();
+			copy(take(iota(0), 16), back_insert_iterable(v));
+		};
+		assert(0 == allocations(fill)); // reserved
+		assert(0 < allocations([&v]() { v.push_back(0); }));
+		assert(0 == allocations(fill, 1));
+	}
+
+	return 0;
+}
+
+int new_handler_test()
+{
+	{
+		static int calls = 0;
+		std::set_new_handler([]() {
+			++calls;
+			std::set_new_handler(nullptr);
+		});
+		bool thrown = false;
+		try {
+			volatile std::size_t n = std::size_t(-1) / 2;
+			char* volatile p = new char[n];
+			delete[] p;
+		}
+		catch (const std::bad_alloc&) {
+			thrown = true;
+		}
+		assert(thrown);
+		assert(calls == 1);
+	}
+
+	return 0;
+}
+
+int main()
+{
+	alloc_test();
+	new_handler_test();
+
+	return 0;
+}
@@ -0,0 +1,58 @@
+// fms_iterable_avx2.t.cpp - test the AVX2 paths of fms_iterable.h
+// Built with -mavx2 and skipped on processors without AVX2.
+#include <cassert>
+#include <vector>
+#include "fms_iterable.h"
+
+#ifndef FMS_ITERABLE_AVX2
+#error "compile with -mavx2"
+#endif
+
+using namespace fms::iterable;
+
+int bloom_test()
+{
+	{
+		bloom<int> b(1000, 0.01);
+		b.add(take(iota(0), 1000));
+		for (int k = 0; k < 1000; ++k) {
+			assert(b.contains(k)); // no false negatives
+		}
+		auto fp = size(filter(std::cref(b), take(iota(1000), 100'000)));
+		assert(fp < 2'000);
+
+		std::vector<int> k(100);
+		copy(take(iota(950), 100), make_interval(k));
+		bool in[100];
+		b.contains(k.data(), k.size(), in);
+		for (std::size_t i = 0; i < 100; ++i) {
+			assert(in[i] == b.contains(k[i]));
+			assert(i >= 50 || in[i]);
+		}
+	}
+	{
+		// one key sets 8 of 256 bits, so few other keys match
+		bloom<int> b(1, 0.5);
+		b.insert(42);
+		assert(b.contains(42));
+		std::size_t n = 0;
+		for (int k = 0; k < 100'000; ++k) {
+			n += b.contains(k);
+		}
+		assert(n < 100);
+	}
+
+	return 0;
+}
+
+int main()
+{
+#if defined(__GNUC__) || defined(__clang__)
+	if (!__builtin_cpu_supports("avx2")) {
+		return 0;
+	}
+#endif
+	bloom_test();
+
+	return 0;
+}
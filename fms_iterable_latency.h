@@ -0,0 +1,395 @@
+// fms_iterable_latency.h - per-element latency histograms
+#pragma once
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+#include "fms_iterable.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#elif defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#endif
+
+namespace fms::iterable {
+
+	// Cheap monotonic ticks: the time stamp counter where available, else ns.
+	struct latency_clock {
+		static std::uint64_t now() noexcept
+		{
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+			return __rdtsc();
+#elif defined(__aarch64__)
+			std::uint64_t t;
+			asm volatile("mrs %0, cntvct_el0" : "=r"(t));
+
+			return t;
+#else
+			return static_cast<std::uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+		}
+		// Measured once, taking about 10ms.
+		static double ticks_per_ns()
+		{
+			static const double r = []() {
+				using clock = std::chrono::steady_clock;
+				const auto t0 = clock::now();
+				const auto c0 = now();
+				while (clock::now() - t0 < std::chrono::milliseconds(10))
+					;
+				const auto c1 = now();
+				const auto ns = std::chrono::duration<double, std::nano>(clock::now() - t0).count();
+
+				return static_cast<double>(c1 - c0) / ns;
+			}();
+
+			return r;
+		}
+	};
+
+	// Log-linear buckets with 2^(S - 1) sub-buckets per power of 2.
+	// Values below 2^S are exact, larger values have relative error below 2^(1 - S).
+	template<unsigned S = 6>
+	struct log_linear {
+		static constexpr std::size_t sub = std::size_t(1) << S;
+		static constexpr std::size_t buckets = sub + (64 - S) * (sub / 2);
+
+		static constexpr std::size_t index(std::uint64_t v) noexcept
+		{
+			if (v < sub) {
+				return static_cast<std::size_t>(v);
+			}
+			const unsigned e = static_cast<unsigned>(std::bit_width(v)) - S;
+
+			return sub + (e - 1) * (sub / 2) + static_cast<std::size_t>((v >> e) - sub / 2);
+		}
+		// Smallest value in bucket k.
+		static constexpr std::uint64_t lower(std::size_t k) noexcept
+		{
+			if (k < sub) {
+				return k;
+			}
+			const auto e = (k - sub) / (sub / 2) + 1;
+			const auto m = (k - sub) % (sub / 2) + sub / 2;
+
+			return static_cast<std::uint64_t>(m) << e;
+		}
+		// Largest value in bucket k.
+		static constexpr std::uint64_t upper(std::size_t k) noexcept
+		{
+			return k + 1 < buckets ? lower(k + 1) - 1 : ~std::uint64_t(0);
+		}
+	};
+
+	// Merged counts of a latency_histogram in clock ticks.
+	struct latency_snapshot {
+		using scale = log_linear<>;
+
+		std::vector<std::uint64_t> counts;
+		double ticks_per_ns;
+
+		std::uint64_t count() const noexcept
+		{
+			std::uint64_t n = 0;
+			for (auto c : counts) {
+				n += c;
+			}
+
+			return n;
+		}
+		// Upper bound of the bucket holding quantile q in [0, 1], in ns.
+		double percentile(double q) const
+		{
+			const auto n = count();
+			if (n == 0) {
+				return 0;
+			}
+			const auto r = static_cast<std::uint64_t>(std::ceil(q * static_cast<double>(n)));
+			std::uint64_t m = 0;
+			for (std::size_t k = 0; k < counts.size(); ++k) {
+				m += counts[k];
+				if (m >= std::max<std::uint64_t>(r, 1)) {
+					return static_cast<double>(scale::upper(k)) / ticks_per_ns;
+				}
+			}
+
+			return static_cast<double>(scale::upper(counts.size() - 1)) / ticks_per_ns;
+		}
+		// Mean using bucket midpoints, in ns.
+		double mean() const
+		{
+			const auto n = count();
+			double s = 0;
+			for (std::size_t k = 0; k < counts.size(); ++k) {
+				if (counts[k]) {
+					s += counts[k] * (static_cast<double>(scale::lower(k)) + static_cast<double>(scale::upper(k) - scale::lower(k)) / 2);
+				}
+			}
+
+			return n ? s / static_cast<double>(n) / ticks_per_ns : 0;
+		}
+	};
+
+	// Latencies in clock ticks with one shard per recording thread.
+	// Recording writes only the thread's own shard. Reading merges all shards.
+	class latency_histogram {
+		using scale = log_linear<>;
+		using shard = std::array<std::atomic<std::uint64_t>, scale::buckets>;
+
+		struct cache {
+			std::uint64_t id;
+			shard* s;
+		};
+		static constexpr std::size_t caches = 16; // per thread, indexed by id
+		static inline std::atomic<std::uint64_t> ids{ 1 };
+
+		const std::uint64_t id;
+		mutable std::mutex m;
+		std::vector<std::pair<std::thread::id, std::unique_ptr<shard>>> shards;
+
+		shard& local()
+		{
+			thread_local std::array<cache, caches> cs{};
+			auto& c = cs[id % caches];
+			if (c.id != id) {
+				std::lock_guard l(m);
+				const auto t = std::this_thread::get_id();
+				shard* s = nullptr;
+				for (auto& [u, p] : shards) {
+					if (u == t) {
+						s = p.get();
+					}
+				}
+				if (!s) {
+					shards.emplace_back(t, std::make_unique<shard>());
+					s = shards.back().second.get();
+				}
+				c = cache{ id, s };
+			}
+
+			return *c.s;
+		}
+	public:
+		latency_histogram()
+			: id(ids.fetch_add(1))
+		{ }
+		latency_histogram(const latency_histogram&) = delete;
+		latency_histogram& operator=(const latency_histogram&) = delete;
+		~latency_histogram() = default;
+
+		void record(std::uint64_t ticks)
+		{
+			auto& c = local()[scale::index(ticks)];
+			c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		}
+
+		latency_snapshot read() const
+		{
+			latency_snapshot s{ std::vector<std::uint64_t>(scale::buckets), latency_clock::ticks_per_ns() };
+			std::lock_guard l(m);
+			for (const auto& [t, p] : shards) {
+				for (std::size_t k = 0; k < scale::buckets; ++k) {
+					s.counts[k] += (*p)[k].load(std::memory_order_relaxed);
+				}
+			}
+
+			return s;
+		}
+	};
+
+	// Value with its entry time.
+	template<class T>
+	struct stamped {
+		T value;
+		std::uint64_t t; // latency_clock ticks, 0 if not sampled
+
+		operator const T&() const noexcept
+		{
+			return value;
+		}
+	};
+
+	// Wrap f to keep the stamp, e.g. apply(keep_stamp(f), stamp(i)).
+	template<class F>
+	inline auto keep_stamp(F f)
+	{
+		return [f = std::move(f)]<class T>(const stamped<T>& s) {
+			return stamped<std::invoke_result_t<const F&, const T&>>{ f(s.value), s.t };
+		};
+	}
+
+	// Stamp every n-th element with the time it became current.
+	// Each clock read costs about 7ns on bare metal, and much more under
+	// virtualization where rdtsc traps, so use n > 1 for low overhead.
+	template<class I>
+	class stamp {
+		I i;
+		std::uint64_t t;
+		std::size_t n, k;
+	public:
+		using iterator_category = std::input_iterator_tag;
+		using value_type = stamped<typename I::value_type>;
+		using reference = value_type&;
+		using pointer = value_type*;
+		using difference_type = typename I::difference_type;
+
+		stamp(I i, std::size_t n = 1)
+			: i(std::move(i)), t(latency_clock::now()), n(n ? n : 1), k(0)
+		{ }
+		stamp(const stamp&) = default;
+		stamp& operator=(const stamp&) = default;
+		stamp(stamp&&) = default;
+		stamp& operator=(stamp&&) = default;
+		~stamp() = default;
+
+		bool operator==(const stamp& s) const
+		{
+			return i == s.i;
+		}
+
+		stamp begin() const
+		{
+			return *this;
+		}
+		// no end()
+
+		explicit operator bool() const
+		{
+			return valid(i);
+		}
+		value_type operator*() const
+		{
+			return value_type{ *i, t };
+		}
+		stamp& operator++()
+		{
+			++i;
+			if (++k == n) {
+				k = 0;
+				t = latency_clock::now();
+			}
+			else {
+				t = 0;
+			}
+
+			return *this;
+		}
+		stamp operator++(int)
+		{
+			auto tmp{ *this };
+
+			operator++();
+
+			return tmp;
+		}
+	};
+
+	// Record the latency of sampled elements in h when they are consumed.
+	// The stamp read by operator* is kept so the source is not evaluated again.
+	template<class I>
+	class unstamp {
+		I i;
+		latency_histogram* h;
+		mutable std::optional<std::uint64_t> t; // stamp of current element
+	public:
+		using iterator_category = std::input_iterator_tag;
+		using value_type = decltype(std::declval<typename I::value_type>().value);
+		using reference = value_type&;
+		using pointer = value_type*;
+		using difference_type = typename I::difference_type;
+
+		unstamp(I i, latency_histogram& h)
+			: i(std::move(i)), h(&h), t(std::nullopt)
+		{ }
+		unstamp(const unstamp&) = default;
+		unstamp& operator=(const unstamp&) = default;
+		unstamp(unstamp&&) = default;
+		unstamp& operator=(unstamp&&) = default;
+		~unstamp() = default;
+
+		bool operator==(const unstamp& u) const
+		{
+			return i == u.i;
+		}
+
+		unstamp begin() const
+		{
+			return *this;
+		}
+		// no end()
+
+		explicit operator bool() const
+		{
+			return valid(i);
+		}
+		value_type operator*() const
+		{
+			auto u = *i;
+			t = u.t;
+
+			return std::move(u.value);
+		}
+		unstamp& operator++()
+		{
+			if (!t) {
+				t = (*i).t;
+			}
+			if (*t) {
+				h->record(latency_clock::now() - *t);
+			}
+			t.reset();
+			++i;
+
+			return *this;
+		}
+		unstamp operator++(int)
+		{
+			auto tmp{ *this };
+
+			operator++();
+
+			return tmp;
+		}
+		template<class S>
+		bool for_each_until(S&& s)
+		{
+			t.reset();
+
+			return fms::iterable::for_each_until(i, [&](const auto& u) {
+				if (!s(u.value)) {
+					t = u.t; // still current, recorded by operator++
+
+					return false;
+				}
+				if (u.t) {
+					h->record(latency_clock::now() - u.t);
+				}
+
+				return true;
+			});
+		}
+	};
+
+	template<class I>
+	struct is_infinite<stamp<I>> : is_infinite<I> {};
+	template<class I>
+	struct is_infinite<unstamp<I>> : is_infinite<I> {};
+	template<class I>
+	struct stage_traits<stamp<I>> {
+		static constexpr std::string_view name = "stamp";
+		using children = std::tuple<I>;
+	};
+	template<class I>
+	struct stage_traits<unstamp<I>> {
+		static constexpr std::string_view name = "unstamp";
+		using children = std::tuple<I>;
+	};
+
+} // namespace fms::iterable
@@ -0,0 +1,401 @@
+// fms_iterable_meter.h - throughput counters in shared memory
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include "fms_iterable.h"
+#if defined(__unix__) || defined(__APPLE__)
+#define FMS_ITERABLE_SHM
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fms::iterable {
+
+	// Counters for one pipeline stage in one cache line.
+	// Bytes are elements * width.
+	struct alignas(64) meter_slot {
+		char name[32];
+		std::atomic<std::uint64_t> elements;
+		std::atomic<std::uint64_t> stall_ns; // estimated time waiting on the source
+		std::uint32_t width; // sizeof value_type
+		std::atomic<std::uint32_t> ready; // 1 if name and width are valid, 2 if released
+	};
+	static_assert(sizeof(meter_slot) == 64);
+
+	// Start of segment followed by capacity slots.
+	struct alignas(64) meter_header {
+		static constexpr std::uint64_t fourcc = 0x524554454d534d46; // "FMSMETER"
+
+		std::uint64_t magic;
+		std::uint32_t capacity;
+		std::atomic<std::uint32_t> count;
+		std::int32_t pid; // creator, 0 if unknown
+	};
+
+	// Fixed size array of meter_slot in POSIX shared memory. Falls back to
+	// process memory if shared memory is not available.
+	class meter_segment {
+		meter_header* h;
+		std::size_t bytes;
+		std::string name;
+		bool shared, owner;
+		std::uint32_t capacity; // 0 if not a valid meter segment
+
+		meter_slot* slots() const noexcept
+		{
+			return reinterpret_cast<meter_slot*>(h + 1);
+		}
+		static std::size_t size_of(std::uint32_t capacity) noexcept
+		{
+			return sizeof(meter_header) + std::size_t(capacity) * sizeof(meter_slot);
+		}
+		void local(std::uint32_t capacity)
+		{
+			bytes = size_of(capacity);
+			h = static_cast<meter_header*>(::operator new(bytes, std::align_val_t(64)));
+			shared = false;
+		}
+#ifdef FMS_ITERABLE_SHM
+		// Meter segment whose creator has exited, e.g. after a crash.
+		bool stale() const
+		{
+			const int fd = ::shm_open(name.c_str(), O_RDONLY, 0);
+			if (fd == -1) {
+				return false;
+			}
+			bool dead = false;
+			struct stat st;
+			if (::fstat(fd, &st) == 0 && static_cast<std::size_t>(st.st_size) >= sizeof(meter_header)) {
+				void* p = ::mmap(nullptr, sizeof(meter_header), PROT_READ, MAP_SHARED, fd, 0);
+				if (p != MAP_FAILED) {
+					const auto* g = static_cast<const meter_header*>(p);
+					dead = g->magic == meter_header::fourcc && g->pid > 0
+						&& ::kill(g->pid, 0) == -1 && errno == ESRCH;
+					::munmap(p, sizeof(meter_header));
+				}
+			}
+			::close(fd);
+
+			return dead;
+		}
+		// Create name exclusively so another process's segment is never clobbered.
+		void create()
+		{
+			int fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+			if (fd == -1 && errno == EEXIST && stale()) {
+				::shm_unlink(name.c_str());
+				fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+			}
+			if (fd == -1) {
+				return;
+			}
+			bytes = size_of(capacity);
+			if (::ftruncate(fd, static_cast<off_t>(bytes)) == 0) {
+				void* p = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+				if (p != MAP_FAILED) {
+					h = static_cast<meter_header*>(p);
+					h->pid = static_cast<std::int32_t>(::getpid());
+					shared = true;
+				}
+			}
+			::close(fd);
+			if (!shared) {
+				::shm_unlink(name.c_str());
+			}
+		}
+		// Map read only and trust the header only if it fits the segment.
+		void attach()
+		{
+			const int fd = ::shm_open(name.c_str(), O_RDONLY, 0);
+			if (fd == -1) {
+				return;
+			}
+			struct stat st;
+			if (::fstat(fd, &st) == 0 && static_cast<std::size_t>(st.st_size) >= sizeof(meter_header)) {
+				bytes = static_cast<std::size_t>(st.st_size);
+				void* p = ::mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+				if (p != MAP_FAILED) {
+					h = static_cast<meter_header*>(p);
+					shared = true;
+					if (h->magic == meter_header::fourcc && size_of(h->capacity) <= bytes) {
+						capacity = h->capacity;
+					}
+				}
+			}
+			::close(fd);
+		}
+#endif
+	public:
+		static constexpr std::uint32_t default_capacity = 256;
+
+		// Create segment name, e.g. "/fms_iterable.1234", removed by the destructor.
+		// A segment left by an exited process is replaced. If name is in use
+		// the counters stay in process memory and is_shared() is false.
+		// Use capacity = 0 to attach read only to an existing segment.
+		meter_segment(std::string name, std::uint32_t capacity = default_capacity)
+			: h(nullptr), bytes(0), name(std::move(name)), shared(false), owner(capacity != 0), capacity(capacity)
+		{
+#ifdef FMS_ITERABLE_SHM
+			if (owner) {
+				create();
+			}
+			else {
+				attach();
+			}
+#endif
+			if (!shared) {
+				local(capacity);
+				h->magic = 0;
+				h->capacity = capacity;
+				h->count.store(0);
+				h->pid = 0;
+			}
+			if (owner) {
+				std::memset(static_cast<void*>(slots()), 0, capacity * sizeof(meter_slot));
+				h->capacity = capacity;
+				h->count.store(0);
+				h->magic = meter_header::fourcc;
+			}
+		}
+		meter_segment(const meter_segment&) = delete;
+		meter_segment& operator=(const meter_segment&) = delete;
+		~meter_segment()
+		{
+#ifdef FMS_ITERABLE_SHM
+			if (shared) {
+				::munmap(h, bytes);
+				if (owner) {
+					::shm_unlink(name.c_str());
+				}
+
+				return;
+			}
+#endif
+			::operator delete(h, std::align_val_t(64));
+		}
+
+		// Counters are visible to other processes.
+		bool is_shared() const noexcept
+		{
+			return shared && capacity != 0;
+		}
+		// Number of registered slots.
+		std::uint32_t size() const noexcept
+		{
+			return std::min(h->count.load(std::memory_order_acquire), capacity);
+		}
+		const meter_slot& operator[](std::uint32_t k) const noexcept
+		{
+			return slots()[k];
+		}
+
+		// Register a stage, reusing a released slot if any.
+		// Returns nullptr if the segment is full or read only.
+		meter_slot* add(std::string_view stage, std::uint32_t width)
+		{
+			if (!owner) {
+				return nullptr;
+			}
+			meter_slot* m = nullptr;
+			for (std::uint32_t k = 0; k < size() && !m; ++k) {
+				std::uint32_t r = 2;
+				if (slots()[k].ready.compare_exchange_strong(r, 0, std::memory_order_acq_rel)) {
+					m = slots() + k;
+					m->elements.store(0, std::memory_order_relaxed);
+					m->stall_ns.store(0, std::memory_order_relaxed);
+				}
+			}
+			if (!m) {
+				const auto k = h->count.fetch_add(1, std::memory_order_acq_rel);
+				if (k >= capacity) {
+					return nullptr;
+				}
+				m = slots() + k;
+			}
+			const auto n = std::min(stage.size(), sizeof(m->name) - 1);
+			std::memcpy(m->name, stage.data(), n);
+			m->name[n] = 0;
+			m->width = width;
+			m->ready.store(1, std::memory_order_release);
+
+			return m;
+		}
+		// Keep the final counts of m until add reuses it.
+		void release(meter_slot* m) noexcept
+		{
+			m->ready.store(2, std::memory_order_release);
+		}
+
+		// Process wide segment named by FMS_ITERABLE_METER or /fms_iterable.<pid>.
+		static meter_segment& global()
+		{
+			static meter_segment s([]() {
+				if (const char* e = std::getenv("FMS_ITERABLE_METER")) {
+					return std::string(e);
+				}
+#ifdef FMS_ITERABLE_SHM
+				return "/fms_iterable." + std::to_string(::getpid());
+#else
+				return std::string("/fms_iterable");
+#endif
+			}());
+
+			return s;
+		}
+	};
+
+	// Count elements of i in a shared meter_slot. Pulling costs one relaxed
+	// increment per element and for_each_until publishes counts in batches.
+	// Time spent in the source is sampled every n elements and scaled by n.
+	template<class I>
+	class metered {
+		using clock = std::chrono::steady_clock;
+		static constexpr std::uint32_t batch = 1024;
+
+		I i;
+		std::shared_ptr<meter_slot> m; // shared by copies, null if segment is full
+		std::uint32_t n, k;
+
+		// Nanoseconds less the cost of reading the clock.
+		static std::uint64_t ns(clock::duration d)
+		{
+			static const clock::duration overhead = []() {
+				auto o = clock::duration::max();
+				for (int j = 0; j < 16; ++j) {
+					const auto t = clock::now();
+					o = std::min(o, clock::now() - t);
+				}
+
+				return o;
+			}();
+
+			return d > overhead ? static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(d - overhead).count()) : 0;
+		}
+	public:
+		using iterator_category = std::input_iterator_tag;
+		using value_type = typename I::value_type;
+		using reference = typename I::reference;
+		using pointer = typename I::pointer;
+		using difference_type = typename I::difference_type;
+
+		// The slot is released when the last copy is destroyed, so s must outlive them.
+		metered(I i, std::string_view name, meter_segment& s = meter_segment::global(), std::uint32_t n = 64)
+			: i(std::move(i)), n(n ? n : 1), k(0)
+		{
+			if (meter_slot* p = s.add(name, sizeof(value_type))) {
+				m = std::shared_ptr<meter_slot>(p, [&s](meter_slot* q) { s.release(q); });
+			}
+		}
+		metered(const metered&) = default;
+		metered& operator=(const metered&) = default;
+		metered(metered&&) = default;
+		metered& operator=(metered&&) = default;
+		~metered() = default;
+
+		bool operator==(const metered& _m) const
+		{
+			return i == _m.i;
+		}
+
+		metered begin() const
+		{
+			return *this;
+		}
+		metered end() const
+			requires has_end<I>
+		{
+			auto e{ *this };
+			e.i = i.end();
+
+			return e;
+		}
+
+		explicit operator bool() const
+		{
+			return valid(i);
+		}
+		value_type operator*() const
+		{
+			return *i;
+		}
+		metered& operator++()
+		{
+			if (++k == n) {
+				k = 0;
+				const auto t = clock::now();
+				++i;
+				if (m) {
+					m->stall_ns.fetch_add(n * ns(clock::now() - t), std::memory_order_relaxed);
+				}
+			}
+			else {
+				++i;
+			}
+			if (m) {
+				m->elements.fetch_add(1, std::memory_order_relaxed);
+			}
+
+			return *this;
+		}
+		metered operator++(int)
+		{
+			auto tmp{ *this };
+
+			operator++();
+
+			return tmp;
+		}
+		template<class S>
+		bool for_each_until(S&& s)
+		{
+			std::uint64_t count = 0, stall = 0;
+			clock::time_point t; // when the last sampled sink call returned
+			const auto flush = [&]() {
+				if (m) {
+					m->elements.fetch_add(count, std::memory_order_relaxed);
+					m->stall_ns.fetch_add(stall, std::memory_order_relaxed);
+				}
+				count = stall = 0;
+			};
+			const bool go = fms::iterable::for_each_until(i, [&](const auto& u) {
+				if (k == 0 && t != clock::time_point{}) {
+					stall += n * ns(clock::now() - t);
+					t = clock::time_point{};
+				}
+				const bool r = s(u);
+				if (++k == n) {
+					k = 0;
+					t = clock::now();
+				}
+				if (++count == batch) {
+					flush();
+				}
+
+				return r;
+			});
+			flush();
+
+			return go;
+		}
+	};
+
+	template<class I>
+	struct is_infinite<metered<I>> : is_infinite<I> {};
+	template<class I>
+	struct stage_traits<metered<I>> {
+		static constexpr std::string_view name = "metered";
+		using children = std::tuple<I>;
+	};
+
+} // namespace fms::iterable
@@ -0,0 +1,169 @@
+// fms_iterable_perf.h - hardware performance counters around a traversal
+#pragma once
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <optional>
+#if defined(__linux__)
+#define FMS_ITERABLE_PERF
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace fms::iterable {
+
+	enum class perf_event {
+		cycles,
+		instructions,
+		branch_misses,
+		l1d_misses,
+		llc_misses,
+		stalled_cycles, // backend
+		size
+	};
+	inline constexpr std::size_t perf_events = static_cast<std::size_t>(perf_event::size);
+	inline constexpr const char* perf_event_name[perf_events] = {
+		"cycles", "instructions", "branch-misses", "L1d-misses", "LLC-misses", "stalled-cycles"
+	};
+
+	// Counter values, empty if the event is not available.
+	struct perf_counts {
+		std::array<std::optional<std::uint64_t>, perf_events> count;
+
+		std::optional<std::uint64_t> operator[](perf_event e) const
+		{
+			return count[static_cast<std::size_t>(e)];
+		}
+		// Count per element for n elements.
+		std::optional<double> per(perf_event e, std::size_t n) const
+		{
+			const auto c = operator[](e);
+			if (!c || n == 0) {
+				return std::nullopt;
+			}
+
+			return static_cast<double>(*c) / static_cast<double>(n);
+		}
+		// Instructions per cycle.
+		std::optional<double> ipc() const
+		{
+			const auto c = operator[](perf_event::cycles);
+			const auto i = operator[](perf_event::instructions);
+			if (!c || !i || *c == 0) {
+				return std::nullopt;
+			}
+
+			return static_cast<double>(*i) / static_cast<double>(*c);
+		}
+
+		// Print per element figures on one line.
+		void report(std::FILE* f, const char* label, std::size_t n) const
+		{
+			std::fprintf(f, "%s:", label);
+			for (std::size_t e = 0; e < perf_events; ++e) {
+				if (const auto x = per(static_cast<perf_event>(e), n)) {
+					std::fprintf(f, " %s/elem %.3f", perf_event_name[e], *x);
+				}
+				else {
+					std::fprintf(f, " %s/elem n/a", perf_event_name[e]);
+				}
+			}
+			if (const auto x = ipc()) {
+				std::fprintf(f, " IPC %.2f\n", *x);
+			}
+			else {
+				std::fprintf(f, " IPC n/a\n");
+			}
+		}
+	};
+
+	// Count hardware events on this thread while in scope.
+	// Events that cannot be opened, e.g. perf_event_paranoid or no PMU, are skipped.
+	class perf_scope {
+		std::array<int, perf_events> fd;
+
+#ifdef FMS_ITERABLE_PERF
+		static int open(std::uint32_t type, std::uint64_t config)
+		{
+			perf_event_attr pe;
+			std::memset(&pe, 0, sizeof(pe));
+			pe.size = sizeof(pe);
+			pe.type = type;
+			pe.config = config;
+			pe.disabled = 1;
+			pe.exclude_kernel = 1;
+			pe.exclude_hv = 1;
+			pe.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+			return static_cast<int>(::syscall(SYS_perf_event_open, &pe, 0, -1, -1, 0));
+		}
+		static constexpr std::uint64_t cache(std::uint64_t id)
+		{
+			return id | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+		}
+#endif
+	public:
+		perf_scope()
+		{
+			fd.fill(-1);
+#ifdef FMS_ITERABLE_PERF
+			fd[0] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+			fd[1] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+			fd[2] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+			fd[3] = open(PERF_TYPE_HW_CACHE, cache(PERF_COUNT_HW_CACHE_L1D));
+			fd[4] = open(PERF_TYPE_HW_CACHE, cache(PERF_COUNT_HW_CACHE_LL));
+			fd[5] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_STALLED_CYCLES_BACKEND);
+			for (int f : fd) {
+				if (f != -1) {
+					::ioctl(f, PERF_EVENT_IOC_RESET, 0);
+					::ioctl(f, PERF_EVENT_IOC_ENABLE, 0);
+				}
+			}
+#endif
+		}
+		perf_scope(const perf_scope&) = delete;
+		perf_scope& operator=(const perf_scope&) = delete;
+		~perf_scope()
+		{
+#ifdef FMS_ITERABLE_PERF
+			for (int f : fd) {
+				if (f != -1) {
+					::close(f);
+				}
+			}
+#endif
+		}
+
+		// At least one event is being counted.
+		bool available() const noexcept
+		{
+			for (int f : fd) {
+				if (f != -1) {
+					return true;
+				}
+			}
+
+			return false;
+		}
+
+		// Counts since construction, scaled if the kernel multiplexed counters.
+		perf_counts read() const
+		{
+			perf_counts c;
+#ifdef FMS_ITERABLE_PERF
+			for (std::size_t e = 0; e < perf_events; ++e) {
+				std::uint64_t v[3]; // value, time enabled, time running
+				if (fd[e] != -1 && ::read(fd[e], v, sizeof(v)) == sizeof(v) && v[2] != 0) {
+					c.count[e] = v[2] == v[1] ? v[0]
+						: static_cast<std::uint64_t>(static_cast<double>(v[0]) * v[1] / v[2]);
+				}
+			}
+#endif
+			return c;
+		}
+	};
+
+} // namespace fms::iterable
@@ -0,0 +1,254 @@
+// fms_iterable_trace.h - Chrome trace events from pipeline stages
+// Compile with FMS_ITERABLE_TRACE defined to record spans. Set the environment
+// variable FMS_ITERABLE_TRACE to a file name to write the trace at exit, then
+// open it in chrome://tracing or ui.perfetto.dev.
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace fms::iterable {
+
+	// Complete event. name and cat must outlive the trace, e.g. string literals.
+	struct trace_event {
+		const char* name;
+		const char* cat;
+		std::int64_t begin, end; // ns since trace start
+	};
+
+	// Events of one thread at a time. Only the owning thread writes.
+	class trace_buffer {
+		std::unique_ptr<trace_event[]> e;
+		std::size_t capacity;
+		std::atomic<std::size_t> n; // published events
+		std::atomic<std::size_t> lost; // dropped when full
+	public:
+		std::uint32_t tid; // set by the registry when leased
+
+		trace_buffer(std::uint32_t tid, std::size_t capacity)
+			: e(new trace_event[capacity]), capacity(capacity), n(0), lost(0), tid(tid)
+		{ }
+
+		void push(const trace_event& t) noexcept
+		{
+			const auto k = n.load(std::memory_order_relaxed);
+			if (k == capacity) {
+				lost.fetch_add(1, std::memory_order_relaxed);
+
+				return;
+			}
+			e[k] = t;
+			n.store(k + 1, std::memory_order_release);
+		}
+		std::size_t size() const noexcept
+		{
+			return n.load(std::memory_order_acquire);
+		}
+		std::size_t dropped() const noexcept
+		{
+			return lost.load(std::memory_order_relaxed);
+		}
+		const trace_event& operator[](std::size_t k) const noexcept
+		{
+			return e[k];
+		}
+		// Only when no thread owns the buffer.
+		void clear() noexcept
+		{
+			n.store(0, std::memory_order_relaxed);
+			lost.store(0, std::memory_order_relaxed);
+		}
+	};
+
+	// Buffers of threads that are tracing, each using about 2MB. When a thread
+	// exits its events are kept at their size and its buffer is cleared for
+	// the next thread, so buffers are bounded by the most threads tracing at
+	// once and every thread gets its own id and capacity.
+	class trace_registry {
+		struct events {
+			std::uint32_t tid;
+			std::vector<trace_event> e;
+		};
+
+		std::mutex m;
+		std::vector<std::unique_ptr<trace_buffer>> bs;
+		std::vector<trace_buffer*> idle; // owning thread exited
+		std::vector<events> done; // of exited threads
+		std::uint32_t tids; // next thread id
+		std::size_t lost; // dropped by exited threads
+		const std::chrono::steady_clock::time_point t0;
+	public:
+		static constexpr std::size_t capacity = 1 << 16; // events per thread
+		std::atomic<bool> enabled;
+
+		trace_registry()
+			: tids(0), lost(0), t0(std::chrono::steady_clock::now()), enabled(true)
+		{ }
+		trace_registry(const trace_registry&) = delete;
+		trace_registry& operator=(const trace_registry&) = delete;
+		~trace_registry()
+		{
+			if (const char* file = std::getenv("FMS_ITERABLE_TRACE")) {
+				if (std::FILE* f = std::fopen(file, "w")) {
+					std::fputs(json().c_str(), f);
+					std::fclose(f);
+				}
+			}
+		}
+
+		std::int64_t now() const noexcept
+		{
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+		}
+
+		trace_buffer* add()
+		{
+			std::lock_guard l(m);
+			if (!idle.empty()) {
+				const auto b = idle.back();
+				idle.pop_back();
+				b->tid = tids++;
+
+				return b;
+			}
+			bs.push_back(std::make_unique<trace_buffer>(tids++, capacity));
+
+			return bs.back().get();
+		}
+		void release(trace_buffer* b)
+		{
+			std::lock_guard l(m);
+			auto& d = done.emplace_back(events{ b->tid, {} });
+			d.e.reserve(b->size());
+			for (std::size_t k = 0; k < b->size(); ++k) {
+				d.e.push_back((*b)[k]);
+			}
+			lost += b->dropped();
+			b->clear();
+			idle.push_back(b);
+		}
+		std::size_t buffers()
+		{
+			std::lock_guard l(m);
+
+			return bs.size();
+		}
+
+		// Buffer of the calling thread.
+		trace_buffer& local();
+
+		std::size_t size()
+		{
+			std::lock_guard l(m);
+			std::size_t n = 0;
+			for (const auto& d : done) {
+				n += d.e.size();
+			}
+			for (const auto& b : bs) {
+				n += b->size();
+			}
+
+			return n;
+		}
+		// Events dropped because a thread's buffer was full.
+		std::size_t dropped()
+		{
+			std::lock_guard l(m);
+			std::size_t n = lost;
+			for (const auto& b : bs) {
+				n += b->dropped();
+			}
+
+			return n;
+		}
+
+		// Chrome trace event format.
+		std::string json()
+		{
+			std::lock_guard l(m);
+			std::string s = "{\"traceEvents\":[";
+			char buf[128];
+			bool first = true;
+			const auto str = [&s](const char* p) {
+				s.push_back('"');
+				for (; *p; ++p) {
+					if (*p == '"' || *p == '\\') {
+						s.push_back('\\');
+					}
+					s.push_back(*p);
+				}
+				s.push_back('"');
+			};
+			const auto event = [&](const trace_event& e, std::uint32_t tid) {
+				s.append(first ? "\n{\"name\":" : ",\n{\"name\":");
+				first = false;
+				str(e.name);
+				s.append(",\"cat\":");
+				str(e.cat);
+				std::snprintf(buf, sizeof(buf), ",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u}",
+					e.begin / 1e3, (e.end - e.begin) / 1e3, tid);
+				s.append(buf);
+			};
+			for (const auto& d : done) {
+				for (const auto& e : d.e) {
+					event(e, d.tid);
+				}
+			}
+			for (const auto& b : bs) {
+				for (std::size_t k = 0; k < b->size(); ++k) {
+					event((*b)[k], b->tid);
+				}
+			}
+			s.append("\n],\"displayTimeUnit\":\"ns\"}\n");
+
+			return s;
+		}
+	};
+
+	inline trace_registry& trace()
+	{
+		static trace_registry r;
+
+		return r;
+	}
+	inline trace_buffer& trace_registry::local()
+	{
+		struct lease {
+			trace_buffer* b;
+			~lease()
+			{
+				trace().release(b);
+			}
+		};
+		thread_local lease l{ add() };
+
+		return *l.b;
+	}
+
+	// Record the lifetime of a scope.
+	class trace_span {
+		const char* name;
+		const char* cat;
+		std::int64_t begin;
+	public:
+		trace_span(const char* name, const char* cat = "fms")
+			: name(name), cat(cat), begin(trace().enabled.load(std::memory_order_relaxed) ? trace().now() : -1)
+		{ }
+		trace_span(const trace_span&) = delete;
+		trace_span& operator=(const trace_span&) = delete;
+		~trace_span()
+		{
+			if (begin >= 0) {
+				auto& r = trace();
+				r.local().push(trace_event{ name, cat, begin, r.now() });
+			}
+		}
+	};
+
+} // namespace fms::iterable
@@ -0,0 +1,83 @@
+// fms_iterable_trace.t.cpp - test fms_iterable.h with FMS_ITERABLE_TRACE
+#define FMS_ITERABLE_TRACE
+#include <cassert>
+#include <set>
+#include <string>
+#include <thread>
+#include "fms_iterable.h"
+
+using namespace fms::iterable;
+
+int trace_test()
+{
+	auto& r = trace();
+	const auto n = r.size();
+	{
+		auto t = traced(take(iota(0), 100), "iota", 10);
+		auto t2{ t };
+		assert(t == t2);
+		t = t2;
+		assert(sum(t) == 4950);
+		while (t) {
+			++t;
+		}
+	}
+	assert(r.size() == n + 20);
+	{
+		auto p = par_apply([](int i) { return i * i; }, take(iota(0), 8), 2);
+		assert(sum(p) == 140);
+	}
+	assert(r.size() >= n + 20 + 8); // tasks, maybe waits
+	r.enabled = false;
+	{
+		trace_span s("off");
+	}
+	r.enabled = true;
+	const auto j = r.json();
+	assert(j.find("{\"name\":\"iota\",\"cat\":\"stage\",\"ph\":\"X\"") != std::string::npos);
+	assert(j.find("\"cat\":\"task\"") != std::string::npos);
+	assert(j.find("\"off\"") == std::string::npos);
+	{
+		// buffers of exited threads are reused
+		const auto span = []() { trace_span s("thread"); };
+		std::thread(span).join();
+		const auto b = r.buffers();
+		const auto m = r.size();
+		for (int k = 0; k < 4; ++k) {
+			std::thread(span).join();
+		}
+		assert(r.buffers() == b);
+		assert(r.size() == m + 4);
+
+		// each thread has its own id
+		std::set<std::string> tids;
+		const auto j = r.json();
+		for (auto k = j.find("\"thread\""); k != std::string::npos; k = j.find("\"thread\"", k + 1)) {
+			const auto t = j.find("\"tid\":", k) + 6;
+			tids.insert(j.substr(t, j.find('}', t) - t));
+		}
+		assert(tids.size() == 5);
+
+		// and its own capacity
+		std::thread([]() {
+			for (std::size_t k = 0; k <= trace_registry::capacity; ++k) {
+				trace_span s("fill");
+			}
+		}).join();
+		const auto lost = r.dropped();
+		assert(lost >= 1);
+		const auto n = r.size();
+		std::thread(span).join();
+		assert(r.size() == n + 1 && r.dropped() == lost);
+		assert(r.buffers() == b);
+	}
+
+	return 0;
+}
+
+int main()
+{
+	trace_test();
+
+	return 0;
+}
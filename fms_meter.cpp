@@ -0,0 +1,54 @@
+// fms_meter.cpp - print metered stage counters from a shared memory segment
+// Usage: fms_meter [segment [seconds]]
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+#include "fms_iterable_meter.h"
+
+using namespace fms::iterable;
+
+int main(int ac, char** av)
+{
+	const char* name = ac > 1 ? av[1] : std::getenv("FMS_ITERABLE_METER");
+	if (!name) {
+		std::fprintf(stderr, "usage: %s segment [seconds]\n", av[0]);
+
+		return 2;
+	}
+	const int seconds = ac > 2 ? std::atoi(av[2]) : 1;
+
+	meter_segment s(name, 0);
+	if (!s.is_shared()) {
+		std::fprintf(stderr, "%s: cannot open %s\n", av[0], name);
+
+		return 1;
+	}
+
+	std::vector<std::uint64_t> e0(s.size()), t0(s.size());
+	for (std::uint32_t k = 0; k < s.size(); ++k) {
+		e0[k] = s[k].elements.load(std::memory_order_relaxed);
+		t0[k] = s[k].stall_ns.load(std::memory_order_relaxed);
+	}
+	const auto start = std::chrono::steady_clock::now();
+	std::this_thread::sleep_for(std::chrono::seconds(seconds));
+	const double dt = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	std::printf("%-32s %14s %14s %14s %8s\n", "stage", "elements", "elements/s", "bytes/s", "stall%");
+	for (std::uint32_t k = 0; k < s.size(); ++k) {
+		const auto& m = s[k];
+		if (!m.ready.load(std::memory_order_acquire)) {
+			continue;
+		}
+		const auto e = m.elements.load(std::memory_order_relaxed);
+		const auto t = m.stall_ns.load(std::memory_order_relaxed);
+		const bool same = k < e0.size() && e >= e0[k] && t >= t0[k]; // else slot was reused
+		const double de = same ? static_cast<double>(e - e0[k]) : static_cast<double>(e);
+		const double dt_ns = same ? static_cast<double>(t - t0[k]) : static_cast<double>(t);
+		std::printf("%-32s %14llu %14.0f %14.0f %8.1f\n", m.name, static_cast<unsigned long long>(e),
+			de / dt, de * m.width / dt, 100 * dt_ns / (dt * 1e9));
+	}
+
+	return 0;
+}